@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Compares the startup time of a scenario configured with per-node ini
+# entries against the same scenario loaded by the LoRaDeployment module.
+#
+# usage: ./benchmark_deployment.sh [examples/n1000-gw2.ini]
+#
+
+INI=${1:-examples/n1000-gw2.ini}
+NAME=$(basename $INI .ini)
+OUT=$(mktemp -d)
+
+# extract positions and initial SF/TP into a deployment file
+awk -F'[][]' '
+/^\*\*\.loRa(Nodes|GW)\[[0-9]+\]/ {
+    kind = ($0 ~ /loRaGW/) ? "gw" : "node"
+    key = kind "," $2
+    split($0, kv, "=")
+    value = kv[2]
+    gsub(/[ a-zA-Z]/, "", value)
+    if ($0 ~ /initialX/) x[key] = value
+    else if ($0 ~ /initialY/) y[key] = value
+    else if ($0 ~ /initialLoRaSF/) sf[key] = value
+    else if ($0 ~ /initialLoRaTP/) tp[key] = value
+    else next
+    keys[key] = 1
+}
+END {
+    print "# kind,index,x,y,sf,tp"
+    for (key in keys)
+        print key "," x[key] "," y[key] "," sf[key] "," tp[key]
+}' $INI > $OUT/$NAME.csv
+
+# same scenario without the per-node entries
+grep -v -E '^\*\*\.loRa(Nodes|GW)\[[0-9]+\]\.\*\*\.?initial(X|Y|LoRaSF|LoRaTP) ' $INI > $OUT/$NAME-deployment.ini
+cat >> $OUT/$NAME-deployment.ini <<END
+**.hasDeployment = true
+**.deployment.deploymentFile = "$OUT/$NAME.csv"
+END
+
+ARGS="-u Cmdenv --sim-time-limit=1s --cmdenv-express-mode=true --output-vector-file=$OUT/out.vec --output-scalar-file=$OUT/out.sca"
+
+echo "ini entries:    $(grep -c '' $INI) lines"
+/usr/bin/time -f "  startup %es, %MkB" $(dirname $0)/../src/run_flora $ARGS -f $INI > /dev/null
+echo "deployment file: $(grep -c '' $OUT/$NAME-deployment.ini) ini lines + $(grep -c '' $OUT/$NAME.csv) CSV lines"
+/usr/bin/time -f "  startup %es, %MkB" $(dirname $0)/../src/run_flora $ARGS -f $OUT/$NAME-deployment.ini > /dev/null
+
+rm -rf $OUT
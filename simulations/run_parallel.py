@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Runs all replications of one or more flora configurations in parallel,
+# one Cmdenv process per core, and collects the scalar results into a single
+# SQLite database indexed by ini file, configuration and run number.
+#
+# usage: ./run_parallel.py [-j N] [-c General] [-o results/parallel] [ini ...]
+#        (defaults to omnetpp.ini; examples/*.ini runs the example suite)
+#
+
+import argparse
+import glob
+import os
+import queue
+import sqlite3
+import subprocess
+import sys
+import threading
+import time
+
+SIMULATIONS_DIR = os.path.dirname(os.path.abspath(__file__))
+RUN_FLORA = os.path.join(SIMULATIONS_DIR, "..", "src", "run_flora")
+
+
+def count_runs(ini, config):
+    output = subprocess.run([RUN_FLORA, "-u", "Cmdenv", "-f", ini, "-c", config, "-s", "-q", "numruns"],
+                            cwd=SIMULATIONS_DIR, capture_output=True, text=True, check=True).stdout
+    return int(output.split()[-1])
+
+
+def run_job(job, core, result_dir):
+    ini, config, run = job
+    name = "%s-%s-%d" % (os.path.splitext(os.path.basename(ini))[0], config, run)
+    scalar_file = os.path.join(result_dir, name + ".sca")
+    args = ["taskset", "-c", str(core), RUN_FLORA, "-u", "Cmdenv", "-f", ini, "-c", config, "-r", str(run),
+            "--cmdenv-express-mode=true", "--**.vector-recording=false",
+            "--output-scalar-file=" + scalar_file,
+            "--output-vector-file=" + os.path.join(result_dir, name + ".vec")]
+    start = time.time()
+    with open(os.path.join(result_dir, name + ".log"), "w") as log:
+        status = subprocess.call(args, cwd=SIMULATIONS_DIR, stdout=log, stderr=subprocess.STDOUT)
+    return name, scalar_file, status, time.time() - start
+
+
+def store_scalars(db, job, scalar_file, status, wallclock):
+    ini, config, run = job
+    cursor = db.execute("INSERT INTO runs (ini, config, run, status, wallclock) VALUES (?, ?, ?, ?, ?)",
+                        (ini, config, run, status, wallclock))
+    run_id = cursor.lastrowid
+    if not os.path.exists(scalar_file):
+        return
+    rows = []
+    with open(scalar_file) as sca:
+        for line in sca:
+            # scalar <module> <name> <value>, names may be quoted
+            if not line.startswith("scalar "):
+                continue
+            fields = line.rstrip("\n").split(" ", 1)[1]
+            module, rest = fields.split(" ", 1)
+            if rest.startswith('"'):
+                end = rest.index('"', 1)
+                name, value = rest[1:end], rest[end + 1:].strip()
+            else:
+                name, value = rest.rsplit(" ", 1)
+            rows.append((run_id, module, name, float(value)))
+    db.executemany("INSERT INTO scalars (run_id, module, name, value) VALUES (?, ?, ?, ?)", rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run flora replications on all cores")
+    parser.add_argument("ini", nargs="*", default=["omnetpp.ini"])
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("-c", "--config", default="General")
+    parser.add_argument("-o", "--output", default="results/parallel")
+    options = parser.parse_args()
+
+    result_dir = os.path.abspath(os.path.join(SIMULATIONS_DIR, options.output))
+    os.makedirs(result_dir, exist_ok=True)
+    inis = [ini for pattern in options.ini for ini in sorted(glob.glob(pattern, root_dir=SIMULATIONS_DIR))]
+    jobs = queue.Queue()
+    for ini in inis:
+        for run in range(count_runs(ini, options.config)):
+            jobs.put((ini, options.config, run))
+    total = jobs.qsize()
+    cores = sorted(os.sched_getaffinity(0))[:options.jobs]
+    print("%d runs on %d cores" % (total, len(cores)))
+
+    db = sqlite3.connect(os.path.join(result_dir, "results.db"), check_same_thread=False)
+    db.executescript("""
+        CREATE TABLE IF NOT EXISTS runs (id INTEGER PRIMARY KEY, ini TEXT, config TEXT, run INTEGER, status INTEGER, wallclock REAL);
+        CREATE TABLE IF NOT EXISTS scalars (run_id INTEGER, module TEXT, name TEXT, value REAL);
+        CREATE INDEX IF NOT EXISTS runs_by_config ON runs (ini, config, run);
+        CREATE INDEX IF NOT EXISTS scalars_by_name ON scalars (name, module);
+    """)
+    lock = threading.Lock()
+    failed = []
+    done = [0]
+
+    # one worker thread per core, each pinning its simulations to that core
+    def worker(core):
+        while True:
+            try:
+                job = jobs.get_nowait()
+            except queue.Empty:
+                return
+            name, scalar_file, status, wallclock = run_job(job, core, result_dir)
+            with lock:
+                store_scalars(db, job, scalar_file, status, wallclock)
+                db.commit()
+                done[0] += 1
+                if status != 0:
+                    failed.append(name)
+                print("[%d/%d] %s: %s in %.1fs" % (done[0], total, name, "ok" if status == 0 else "FAILED", wallclock))
+
+    start = time.time()
+    threads = [threading.Thread(target=worker, args=(core,)) for core in cores]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    db.close()
+    print("%d runs finished in %.1fs wall-clock, %d failed, results in %s" % (total, time.time() - start, len(failed), result_dir))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
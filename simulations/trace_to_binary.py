@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+#
+# Converts an uplink log in CSV form into the binary traffic trace replayed by
+# SimpleLoRaApp (trafficTrace parameter, format in src/LoRaApp/LoRaTrafficTrace.h).
+#
+# input lines: device,time,payloadSize  (device 0..N-1, time in seconds,
+#              payload in bytes; '#' lines are comments)
+#
+# usage: ./trace_to_binary.py uplinks.csv uplinks.trace
+#
+
+import array
+import csv
+import struct
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: %s <input.csv> <output.trace>" % sys.argv[0], file=sys.stderr)
+        return 1
+    times = {}
+    sizes = {}
+    with open(sys.argv[1]) as log:
+        for row in csv.reader(line for line in log if line.strip() and not line.startswith("#")):
+            device, time, size = int(row[0]), float(row[1]), int(row[2])
+            if device < 0 or time < 0 or not 0 < size < 2 ** 32:
+                raise ValueError("invalid record: %s" % ",".join(row))
+            times.setdefault(device, array.array("d")).append(time)
+            sizes.setdefault(device, array.array("L")).append(size)
+
+    num_devices = max(times) + 1 if times else 0
+    with open(sys.argv[2], "wb") as trace:
+        trace.write(struct.pack("<8sII", b"FLORATRC", 1, num_devices))
+        first = 0
+        for device in range(num_devices):
+            count = len(times.get(device, ()))
+            trace.write(struct.pack("<QQ", first, count))
+            first += count
+        for device in range(num_devices):
+            records = sorted(zip(times.get(device, ()), sizes.get(device, ())))
+            for time, size in records:
+                trace.write(struct.pack("<dII", time, size, 0))
+    print("%d devices, %d uplinks" % (num_devices, first))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# Runs a scenario with the full radio medium and with analytical uplinks and
+# compares the network server's delivery ratio, the gateways' data extraction
+# rates and the wall-clock time of both runs.
+#
+# usage: ./validate_analytical.sh [examples/n100-gw1.ini] [config]
+#
+
+INI=${1:-examples/n100-gw1.ini}
+CONFIG=${2:-General}
+OUT=$(mktemp -d)
+
+ARGS="-u Cmdenv -f $INI -c $CONFIG -r 0 --cmdenv-express-mode=true --**.vector-recording=false"
+
+for mode in full analytical; do
+    EXTRA=""
+    [ $mode = analytical ] && EXTRA="--**.LoRaMedium.analyticalUplinks=true"
+    /usr/bin/time -f "$mode: %es" -o $OUT/$mode.time $(dirname $0)/../src/run_flora $ARGS $EXTRA --output-scalar-file=$OUT/$mode.sca > $OUT/$mode.log || { cat $OUT/$mode.log; exit 1; }
+done
+
+# scalar <module> <name> <value>, some names are quoted
+scalars() {
+    grep -E '^scalar .*(LoRa_NS_DER|"DER[^"]*")' $1 | sed 's/^scalar //' | sort
+}
+
+printf "%-60s %12s %12s\n" name full analytical
+join -t'|' <(scalars $OUT/full.sca | sed -E 's/ ([^ ]+)$/|\1/') <(scalars $OUT/analytical.sca | sed -E 's/ ([^ ]+)$/|\1/') | \
+    awk -F'|' '{ printf "%-60s %12s %12s\n", $1, $2, $3 }'
+cat $OUT/full.time $OUT/analytical.time
+
+rm -rf $OUT
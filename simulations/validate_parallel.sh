@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# Runs a scenario sequentially, split into geographic partitions in one
+# process, and split into partitions under parallel simulation with one
+# process per partition, and compares the network server's delivery ratio,
+# the gateways' data extraction rates and the wall-clock time of the runs.
+# The sequential run writes the partition file with LoRaDeployment, and all
+# runs use the same capture delay. The processes of the parallel run draw
+# different random numbers, so their figures match the others statistically
+# rather than exactly.
+#
+# usage: ./validate_parallel.sh [examples/n1000-gw2.ini] [config] [partitions]
+#
+
+INI=${1:-examples/n1000-gw2.ini}
+CONFIG=${2:-General}
+PARTITIONS=${3:-2}
+# 5 preamble symbols at SF7 and 125 kHz
+CAPTURE_DELAY=${CAPTURE_DELAY:-5.12ms}
+OUT=$(mktemp -d)
+RUN_FLORA=$(dirname $0)/../src/run_flora
+
+ARGS="-u Cmdenv -r 0 --cmdenv-express-mode=true --**.vector-recording=false --**.LoRaMedium.propagation.captureDelay=$CAPTURE_DELAY"
+
+/usr/bin/time -f "sequential: %es" -o $OUT/sequential.time $RUN_FLORA $ARGS -f $INI -c $CONFIG \
+    --*.hasDeployment=true --**.deployment.deploymentType='""' \
+    --**.deployment.numPartitions=$PARTITIONS --**.deployment.partitionFile="\"$OUT/partitions.ini\"" \
+    --output-scalar-file=$OUT/sequential.sca > $OUT/sequential.log || { cat $OUT/sequential.log; exit 1; }
+
+cat > $OUT/partitioned.ini <<END
+include $(realpath $INI)
+
+[Config Partitioned]
+$([ $CONFIG != General ] && echo "extends = $CONFIG")
+parsim-communications-class = "cNamedPipeCommunications"
+parsim-namedpipecommunications-prefix = "$OUT/comm/"
+parsim-synchronization-class = "cNullMessageProtocol"
+include $OUT/partitions.ini
+END
+mkdir $OUT/comm
+
+/usr/bin/time -f "partitioned: %es" -o $OUT/partitioned.time $RUN_FLORA $ARGS -f $OUT/partitioned.ini -c Partitioned \
+    --parallel-simulation=false --output-scalar-file=$OUT/partitioned.sca > $OUT/partitioned.log || { cat $OUT/partitioned.log; exit 1; }
+
+START=$(date +%s.%N)
+for ((k = 0; k < PARTITIONS; k++)); do
+    $RUN_FLORA $ARGS -f $OUT/partitioned.ini -c Partitioned --parallel-simulation=true -p$k,$PARTITIONS \
+        --output-scalar-file=$OUT/parallel-p$k.sca > $OUT/parallel-p$k.log &
+done
+wait || { cat $OUT/parallel-p*.log; exit 1; }
+for ((k = 0; k < PARTITIONS; k++)); do
+    grep -q "End." $OUT/parallel-p$k.log || { cat $OUT/parallel-p$k.log; exit 1; }
+done
+echo "parallel: $(echo "$(date +%s.%N) - $START" | bc)s" > $OUT/parallel.time
+cat $OUT/parallel-p*.sca > $OUT/parallel.sca
+
+# scalar <module> <name> <value>, some names are quoted
+scalars() {
+    grep -E '^scalar .*(LoRa_NS_DER|"DER[^"]*")' $1 | sed 's/^scalar //' | sort
+}
+
+printf "%-60s %12s %12s %12s\n" name sequential partitioned parallel
+join -t'|' <(scalars $OUT/sequential.sca | sed -E 's/ ([^ ]+)$/|\1/') <(scalars $OUT/partitioned.sca | sed -E 's/ ([^ ]+)$/|\1/') | \
+    join -t'|' - <(scalars $OUT/parallel.sca | sed -E 's/ ([^ ]+)$/|\1/') | \
+    awk -F'|' '{ printf "%-60s %12s %12s %12s\n", $1, $2, $3, $4 }'
+grep -h partitionLookahead $OUT/sequential.sca
+cat $OUT/sequential.time $OUT/partitioned.time $OUT/parallel.time
+
+rm -rf $OUT
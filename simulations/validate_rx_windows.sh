@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Runs a scenario with switched and with analytical RX windows and checks
+# that the nodes consume the same energy and receive the same downlinks;
+# prints the wall-clock time of both runs.
+#
+# usage: ./validate_rx_windows.sh [examples/n100-gw1.ini] [config]
+#
+
+INI=${1:-examples/n100-gw1.ini}
+CONFIG=${2:-General}
+OUT=$(mktemp -d)
+
+ARGS="-u Cmdenv -f $INI -c $CONFIG -r 0 --cmdenv-express-mode=true --**.vector-recording=false"
+
+for mode in switched analytical; do
+    EXTRA=""
+    [ $mode = analytical ] && EXTRA="--**.LoRaNic.mac.analyticalRxWindows=true"
+    /usr/bin/time -f "$mode: %es" -o $OUT/$mode.time $(dirname $0)/../src/run_flora $ARGS $EXTRA --output-scalar-file=$OUT/$mode.sca > $OUT/$mode.log || { cat $OUT/$mode.log; exit 1; }
+done
+
+# sum of a scalar over all modules
+total() {
+    awk -v name="$2" '$1 == "scalar" && $3 == name { sum += $4 } END { printf "%.9g\n", sum }' $1
+}
+
+STATUS=0
+printf "%-24s %16s %16s\n" name switched analytical
+for name in totalEnergyConsumed numReceived; do
+    a=$(total $OUT/switched.sca $name)
+    b=$(total $OUT/analytical.sca $name)
+    printf "%-24s %16s %16s\n" $name $a $b
+    awk -v a=$a -v b=$b 'BEGIN { d = a - b; if (d < 0) d = -d; exit !(d <= 1e-9 * (a < 0 ? -a : a)) }' || { echo "$name differs"; STATUS=1; }
+done
+printf "%-24s %16s %16s\n" numAnalyticalRxWindows - $(total $OUT/analytical.sca numAnalyticalRxWindows)
+cat $OUT/switched.time $OUT/analytical.time
+
+rm -rf $OUT
+exit $STATUS
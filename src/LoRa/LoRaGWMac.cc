@@ -16,6 +16,7 @@
 #include "LoRaGWMac.h"
 #include "inet/common/ModuleAccess.h"
 #include "../LoRaPhy/LoRaPhyPreamble_m.h"
+#include "../LoRaPhy/LoRaTransmitter.h"
 #include "inet/common/ProtocolTag_m.h"
 
 
@@ -118,14 +119,7 @@ void LoRaGWMac::handleUpperMessage(cMessage *msg)
 
 
         waitingForDC = true;
-        double delta;
-        if(frame->getLoRaSF() == 7) delta = 0.61696;
-        if(frame->getLoRaSF() == 8) delta = 1.23392;
-        if(frame->getLoRaSF() == 9) delta = 2.14016;
-        if(frame->getLoRaSF() == 10) delta = 4.28032;
-        if(frame->getLoRaSF() == 11) delta = 7.24992;
-        if(frame->getLoRaSF() == 12) delta = 14.49984;
-        scheduleAt(simTime() + delta, dutyCycleTimer);
+        scheduleAt(simTime() + getDutyCycleDelta(pkt), dutyCycleTimer);
         GW_forwardedDown++;
         pkt->addTagIfAbsent<PacketProtocolTag>()->setProtocol(&Protocol::apskPhy);
         sendDown(pkt);
@@ -179,6 +173,14 @@ void LoRaGWMac::receiveSignal(cComponent *source, simsignal_t signalID, intval_t
     }
 }
 
+simtime_t LoRaGWMac::getDutyCycleDelta(const Packet *downlink)
+{
+    // 10% duty cycle of the RX2 sub-band; the whole MAC frame is the PHY
+    // payload the radio transmits
+    const auto &frame = downlink->peekAtFront<LoRaMacFrame>();
+    return 10 * LoRaTransmitter::computeAirtime(downlink->getByteLength(), frame->getLoRaSF(), frame->getLoRaBW(), frame->getLoRaCR());
+}
+
 MacAddress LoRaGWMac::getAddress()
 {
     return address;
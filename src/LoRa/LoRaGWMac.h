@@ -56,6 +56,9 @@ public:
     void createFakeLoRaMacFrame();
     virtual MacAddress getAddress();
 
+    // off-time imposed by the duty cycle after sending the downlink
+    static simtime_t getDutyCycleDelta(const Packet *downlink);
+
 protected:
     MacAddress address;
 
@@ -274,6 +274,31 @@ void LoRaGWRadio::endReception(cMessage *timer)
     delete timer;
 }
 
+void LoRaGWRadio::handleAnalyticalReception(const LoRaReception *reception, const std::vector<const IReception *> *interferingReceptions)
+{
+    Enter_Method("handleAnalyticalReception");
+    emit(LoRaGWRadioReceptionStarted, true);
+    if (simTime() >= getSimulation()->getWarmupPeriod())
+        LoRaGWRadioReceptionStarted_counter++;
+    // half-duplex: nothing is received while a downlink is on air
+    if (iAmTransmiting) {
+        EV_INFO << "LoRaGWRadio Reception ended: ignoring analytical " << reception << " while transmitting" << endl;
+        return;
+    }
+    if (!check_and_cast<const LoRaReceiver *>(receiver)->computeIsAnalyticalReceptionSuccessful(reception, interferingReceptions)) {
+        EV_INFO << "LoRaGWRadio Reception ended: unsuccessfully for analytical " << reception << endl;
+        return;
+    }
+    auto macFrame = check_and_cast<LoRaMedium *>(medium.get())->computeAnalyticalPacket(reception);
+    take(macFrame);
+    EV_INFO << "LoRaGWRadio Reception ended: successfully for analytical " << macFrame << endl;
+    emit(packetSentToUpperSignal, macFrame);
+    emit(LoRaGWRadioReceptionFinishedCorrect, true);
+    if (simTime() >= getSimulation()->getWarmupPeriod())
+        LoRaGWRadioReceptionFinishedCorrect_counter++;
+    sendUp(macFrame);
+}
+
 void LoRaGWRadio::abortReception(cMessage *timer)
 {
     auto radioFrame = static_cast<WirelessSignal *>(timer->getControlInfo());
@@ -56,6 +56,12 @@ protected:
 
 
 public:
+    /**
+     * Decides and accounts for an uplink the medium evaluates analytically,
+     * and passes it up if it was received.
+     */
+    void handleAnalyticalReception(const LoRaReception *reception, const std::vector<const IReception *> *interferingReceptions);
+
     bool iAmGateway;
 
     std::list<cMessage *>concurrentReceptions;
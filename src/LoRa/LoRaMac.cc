@@ -24,6 +24,9 @@
 #include "LoRaTagInfo_m.h"
 #include "inet/common/ProtocolTag_m.h"
 #include "inet/linklayer/common/InterfaceTag_m.h"
+#include "LoRaPhy/LoRaTransmitter.h"
+#include "LoRaPhy/LoRaCounterRng.h"
+#include "LoRaEnergyModules/LoRaEnergyConsumer.h"
 
 
 namespace flora {
@@ -35,11 +38,12 @@ LoRaMac::~LoRaMac()
     cancelAndDelete(endTransmission);
     cancelAndDelete(endReception);
     cancelAndDelete(droppedPacket);
-    cancelAndDelete(endDelay_1);
-    cancelAndDelete(endListening_1);
-    cancelAndDelete(endDelay_2);
-    cancelAndDelete(endListening_2);
+    cancelAndDelete(rxWindowTimer);
     cancelAndDelete(mediumStateChange);
+    cancelAndDelete(endRetransmissionBackoff);
+    cancelAndDelete(pingSlotStart);
+    cancelAndDelete(pingSlotEnd);
+    delete pendingConfirmedFrame;
 }
 
 /****************************************************************
@@ -52,15 +56,32 @@ void LoRaMac::initialize(int stage)
         EV << "Initializing stage 0\n";
 
         //maxQueueSize = par("maxQueueSize");
-        headerLength = par("headerLength");
-        ackLength = par("ackLength");
+        // CsmaCaMac declares these in bits
+        headerLength = par("headerLength").intValueInUnit("B");
+        ackLength = par("ackLength").intValueInUnit("B");
         ackTimeout = par("ackTimeout");
         retryLimit = par("retryLimit");
-
-        waitDelay1Time = 1;
-        listening1Time = 1;
-        waitDelay2Time = 1;
-        listening2Time = 1;
+        confirmedUplinks = par("confirmedUplinks");
+        const char *deviceClassString = par("deviceClass");
+        if (!strcmp(deviceClassString, "A"))
+            deviceClass = CLASS_A;
+        else if (!strcmp(deviceClassString, "B"))
+            deviceClass = CLASS_B;
+        else if (!strcmp(deviceClassString, "C"))
+            deviceClass = CLASS_C;
+        else
+            throw cRuntimeError("Unknown device class '%s'", deviceClassString);
+        pingSlotPeriodicity = par("pingSlotPeriodicity");
+        if (pingSlotPeriodicity < 0 || pingSlotPeriodicity > 7)
+            throw cRuntimeError("Invalid ping slot periodicity %d", pingSlotPeriodicity);
+        pingSlotDuration = par("pingSlotDuration");
+
+        receiveDelay1 = par("receiveDelay1");
+        receiveDelay2 = par("receiveDelay2");
+        receiveWindow1Length = par("receiveWindow1Length");
+        receiveWindow2Length = par("receiveWindow2Length");
+        if (receiveDelay1 + receiveWindow1Length > receiveDelay2)
+            throw cRuntimeError("RX1 must end before RX2 opens");
 
         const char *addressString = par("address");
         if (!strcmp(addressString, "auto")) {
@@ -72,22 +93,32 @@ void LoRaMac::initialize(int stage)
         else
             address.setAddress(addressString);
 
+        analyticalRxWindows = par("analyticalRxWindows");
+        if (analyticalRxWindows) {
+            if (deviceClass != CLASS_A)
+                throw cRuntimeError("Analytical RX windows require a class A device");
+        }
+
         // subscribe for the information of the carrier sense
         cModule *radioModule = getModuleFromPar<cModule>(par("radioModule"), this);
         radioModule->subscribe(IRadio::receptionStateChangedSignal, this);
         radioModule->subscribe(IRadio::transmissionStateChangedSignal, this);
         radioModule->subscribe(LoRaRadio::droppedPacket, this);
+        if (analyticalRxWindows)
+            radioModule->subscribe(LoRaRadio::downlinkAnnouncedSignal, this);
         radio = check_and_cast<IRadio *>(radioModule);
+        if (analyticalRxWindows)
+            energyConsumer = dynamic_cast<LoRaEnergyConsumer *>(radioModule->getSubmodule("energyConsumer"));
 
         // initialize self messages
         endTransmission = new cMessage("Transmission");
         endReception = new cMessage("Reception");
         droppedPacket = new cMessage("Dropped Packet");
-        endDelay_1 = new cMessage("Delay_1");
-        endListening_1 = new cMessage("Listening_1");
-        endDelay_2 = new cMessage("Delay_2");
-        endListening_2 = new cMessage("Listening_2");
+        rxWindowTimer = new cMessage("RxWindow");
         mediumStateChange = new cMessage("MediumStateChange");
+        endRetransmissionBackoff = new cMessage("RetransmissionBackoff");
+        pingSlotStart = new cMessage("PingSlotStart");
+        pingSlotEnd = new cMessage("PingSlotEnd");
 
         // set up internal queue
         txQueue = getQueue(gate(upperLayerInGateId));//check_and_cast<queueing::IPacketQueue *>(getSubmodule("queue"));
@@ -109,6 +140,10 @@ void LoRaMac::initialize(int stage)
         numReceived = 0;
         numSentBroadcast = 0;
         numReceivedBroadcast = 0;
+        numAcked = 0;
+        retransmissionAirtime = 0;
+        numAnalyticalRxWindows = 0;
+        analyticalListeningTime = 0;
 
         // initialize watches
         WATCH(fsm);
@@ -123,8 +158,11 @@ void LoRaMac::initialize(int stage)
         WATCH(numSentBroadcast);
         WATCH(numReceivedBroadcast);
     }
-    else if (stage == INITSTAGE_LINK_LAYER)
+    else if (stage == INITSTAGE_LINK_LAYER) {
         radio->setRadioMode(IRadio::RADIO_MODE_SLEEP);
+        if (deviceClass == CLASS_B)
+            scheduleNextPingSlot();
+    }
 }
 
 void LoRaMac::finish()
@@ -137,6 +175,14 @@ void LoRaMac::finish()
     recordScalar("numReceived", numReceived);
     recordScalar("numSentBroadcast", numSentBroadcast);
     recordScalar("numReceivedBroadcast", numReceivedBroadcast);
+    if (confirmedUplinks) {
+        recordScalar("numAcked", numAcked);
+        recordScalar("retransmissionAirtime", retransmissionAirtime);
+    }
+    if (analyticalRxWindows) {
+        recordScalar("numAnalyticalRxWindows", numAnalyticalRxWindows);
+        recordScalar("analyticalListeningTime", analyticalListeningTime);
+    }
 }
 
 void LoRaMac::configureNetworkInterface()
@@ -161,6 +207,11 @@ void LoRaMac::configureNetworkInterface()
 void LoRaMac::handleSelfMessage(cMessage *msg)
 {
     EV << "received self message: " << msg << endl;
+    if (msg == pingSlotStart) {
+        // slots missed while busy are skipped, the schedule goes on
+        scheduleAt(simTime() + pingSlotDuration, pingSlotEnd);
+        scheduleNextPingSlot();
+    }
     handleWithFsm(msg);
 }
 #if 0
@@ -210,7 +261,7 @@ void LoRaMac::handleUpperPacket(Packet *packet)
 
 void LoRaMac::handleLowerPacket(Packet *msg)
 {
-    if( (fsm.getState() == RECEIVING_1) || (fsm.getState() == RECEIVING_2)) handleWithFsm(msg);
+    if( (fsm.getState() == RECEIVING_1) || (fsm.getState() == RECEIVING_2) || (fsm.getState() == RECEIVING_DOWNLINK)) handleWithFsm(msg);
     else delete msg;
 }
 
@@ -228,7 +279,8 @@ queueing::IPassivePacketSource *LoRaMac::getProvider(cGate *gate)
 void LoRaMac::handleCanPullPacketChanged(cGate *gate)
 {
     Enter_Method("handleCanPullPacketChanged");
-    if (fsm.getState() == IDLE && !txQueue->isEmpty()) {
+    // new uplinks wait in the queue until the confirmed one is done
+    if (fsm.getState() == IDLE && !txQueue->isEmpty() && pendingConfirmedFrame == nullptr) {
         processUpperPacket();
     }
 }
@@ -252,11 +304,24 @@ void LoRaMac::handleWithFsm(cMessage *msg)
     {
         FSMA_State(IDLE)
         {
-            FSMA_Enter(turnOffReceiver());
+            FSMA_Enter(turnOnIdleReceiver());
             FSMA_Event_Transition(Idle-Transmit,
                                   isUpperMessage(msg),
                                   TRANSMIT,
             );
+            FSMA_Event_Transition(Idle-Retransmit,
+                                  msg == endRetransmissionBackoff,
+                                  TRANSMIT,
+                startRetransmission();
+            );
+            FSMA_Event_Transition(Idle-PingSlot,
+                                  msg == pingSlotStart,
+                                  PING_SLOT,
+            );
+            FSMA_Event_Transition(Idle-ReceivingDownlink,
+                                  msg == mediumStateChange && isReceiving() && deviceClass == CLASS_C,
+                                  RECEIVING_DOWNLINK,
+            );
         }
         FSMA_State(TRANSMIT)
         {
@@ -270,17 +335,17 @@ void LoRaMac::handleWithFsm(cMessage *msg)
         }
         FSMA_State(WAIT_DELAY_1)
         {
-            FSMA_Enter(turnOffReceiver());
+            FSMA_Enter(scheduleRxWindowBoundary());
             FSMA_Event_Transition(Wait_Delay_1-Listening_1,
-                                  msg == endDelay_1 || endDelay_1->isScheduled() == false,
+                                  msg == rxWindowTimer,
                                   LISTENING_1,
             );
         }
         FSMA_State(LISTENING_1)
         {
-            FSMA_Enter(turnOnReceiver());
+            FSMA_Enter(scheduleRxWindowBoundary());
             FSMA_Event_Transition(Listening_1-Wait_Delay_2,
-                                  msg == endListening_1 || endListening_1->isScheduled() == false,
+                                  msg == rxWindowTimer,
                                   WAIT_DELAY_2,
             );
             FSMA_Event_Transition(Listening_1-Receiving1,
@@ -297,11 +362,12 @@ void LoRaMac::handleWithFsm(cMessage *msg)
             FSMA_Event_Transition(Receive-Unicast,
                                   isLowerMessage(msg) && isForUs(frame),
                                   IDLE,
-                sendUp(decapsulate(pkt));
+                handleAck(frame);
+                // a bare ACK is deleted below, there is nothing to send up
+                if (pkt->getDataLength() > frame->getChunkLength())
+                    sendUp(decapsulate(pkt));
                 numReceived++;
-                cancelEvent(endListening_1);
-                cancelEvent(endDelay_2);
-                cancelEvent(endListening_2);
+                cancelEvent(rxWindowTimer);
             );
             FSMA_Event_Transition(Receive-BelowSensitivity,
                                   msg == droppedPacket,
@@ -311,18 +377,20 @@ void LoRaMac::handleWithFsm(cMessage *msg)
         }
         FSMA_State(WAIT_DELAY_2)
         {
-            FSMA_Enter(turnOffReceiver());
+            FSMA_Enter(scheduleRxWindowBoundary());
             FSMA_Event_Transition(Wait_Delay_2-Listening_2,
-                                  msg == endDelay_2 || endDelay_2->isScheduled() == false,
+                                  msg == rxWindowTimer,
                                   LISTENING_2,
             );
         }
         FSMA_State(LISTENING_2)
         {
-            FSMA_Enter(turnOnReceiver());
+            FSMA_Enter(scheduleRxWindowBoundary());
             FSMA_Event_Transition(Listening_2-idle,
-                                  msg == endListening_2 || endListening_2->isScheduled() == false,
+                                  msg == rxWindowTimer,
                                   IDLE,
+                closeRxWindow();
+                handleMissingAck();
             );
             FSMA_Event_Transition(Listening_2-Receiving2,
                                   msg == mediumStateChange && isReceiving(),
@@ -338,15 +406,49 @@ void LoRaMac::handleWithFsm(cMessage *msg)
             FSMA_Event_Transition(Receive2-Unicast,
                                   isLowerMessage(msg) && isForUs(frame),
                                   IDLE,
-                sendUp(pkt);
+                handleAck(frame);
+                // a bare ACK is deleted below, there is nothing to send up
+                if (pkt->getDataLength() > frame->getChunkLength())
+                    sendUp(decapsulate(pkt));
                 numReceived++;
-                cancelEvent(endListening_2);
+                cancelEvent(rxWindowTimer);
             );
             FSMA_Event_Transition(Receive2-BelowSensitivity,
                                   msg == droppedPacket,
                                   LISTENING_2,
             );
         }
+        FSMA_State(PING_SLOT)
+        {
+            FSMA_Enter(turnOnReceiver());
+            FSMA_Event_Transition(PingSlot-Idle,
+                                  msg == pingSlotEnd,
+                                  IDLE,
+            );
+            FSMA_Event_Transition(PingSlot-ReceivingDownlink,
+                                  msg == mediumStateChange && isReceiving(),
+                                  RECEIVING_DOWNLINK,
+            );
+        }
+        FSMA_State(RECEIVING_DOWNLINK)
+        {
+            FSMA_Event_Transition(ReceiveDownlink-Unicast-Not-For,
+                                  isLowerMessage(msg) && !isForUs(frame),
+                                  IDLE,
+            );
+            FSMA_Event_Transition(ReceiveDownlink-Unicast,
+                                  isLowerMessage(msg) && isForUs(frame),
+                                  IDLE,
+                handleAckOutsideRxWindows(frame);
+                if (pkt->getDataLength() > frame->getChunkLength())
+                    sendUp(decapsulate(pkt));
+                numReceived++;
+            );
+            FSMA_Event_Transition(ReceiveDownlink-BelowSensitivity,
+                                  msg == droppedPacket,
+                                  IDLE,
+            );
+        }
     }
 
 //    if (fsm.getState() == IDLE) {
@@ -365,7 +467,11 @@ void LoRaMac::handleWithFsm(cMessage *msg)
             handleWithFsm(mediumStateChange);
         else if (currentTxFrame != nullptr)
             handleWithFsm(currentTxFrame);
-        else if (!txQueue->isEmpty()) {
+        // the backoff ended in a ping slot or while receiving a downlink,
+        // the retransmission starts as soon as the device is idle again
+        else if (pendingConfirmedFrame != nullptr && !endRetransmissionBackoff->isScheduled())
+            handleWithFsm(endRetransmissionBackoff);
+        else if (!txQueue->isEmpty() && pendingConfirmedFrame == nullptr) {
             processUpperPacket();
         }
     }
@@ -396,6 +502,8 @@ void LoRaMac::receiveSignal(cComponent *source, simsignal_t signalID, intval_t v
         radio->setRadioMode(IRadio::RADIO_MODE_SLEEP);
         handleWithFsm(droppedPacket);
     }
+    else if (signalID == LoRaRadio::downlinkAnnouncedSignal)
+        handlePendingDownlink();
     else if (signalID == IRadio::transmissionStateChangedSignal) {
         IRadio::TransmissionState newRadioTransmissionState = (IRadio::TransmissionState)value;
         if (transmissionState == IRadio::TRANSMISSION_STATE_TRANSMITTING && newRadioTransmissionState == IRadio::TRANSMISSION_STATE_IDLE) {
@@ -421,6 +529,7 @@ Packet *LoRaMac::encapsulate(Packet *msg)
     frame->setLoRaCR(tag->getCodeRendundance());
     frame->setSequenceNumber(sequenceNumber);
     frame->setReceiverAddress(MacAddress::BROADCAST_ADDRESS);
+    frame->setConfirmed(confirmedUplinks);
 
     ++sequenceNumber;
     //frame->setLoRaUseHeader(cInfo->getLoRaUseHeader());
@@ -497,14 +606,81 @@ void LoRaMac::sendAckFrame()
  */
 void LoRaMac::finishCurrentTransmission()
 {
-    scheduleAt(simTime() + waitDelay1Time, endDelay_1);
-    scheduleAt(simTime() + waitDelay1Time + listening1Time, endListening_1);
-    scheduleAt(simTime() + waitDelay1Time + listening1Time + waitDelay2Time, endDelay_2);
-    scheduleAt(simTime() + waitDelay1Time + listening1Time + waitDelay2Time + listening2Time, endListening_2);
-    deleteCurrentTxFrame();
+    rxWindowsStart = simTime();
+    downlinkPending = false;
+    if (confirmedUplinks) {
+        // keep the frame with its sequence number for retransmissions
+        pendingConfirmedFrame = currentTxFrame;
+        currentTxFrame = nullptr;
+    }
+    else
+        deleteCurrentTxFrame();
     //popTxQueue();
 }
 
+void LoRaMac::handleAck(const Ptr<const LoRaMacFrame> &frame)
+{
+    if (pendingConfirmedFrame == nullptr)
+        return;
+    // any downlink closes the receive windows, so one without the ACK
+    // counts as a missing ACK
+    if (!isAck(frame)) {
+        handleMissingAck();
+        return;
+    }
+    EV << "confirmed uplink acknowledged after " << retryCounter << " retransmissions\n";
+    if (retryCounter == 0)
+        numSentWithoutRetry++;
+    numAcked++;
+    retryCounter = 0;
+    delete pendingConfirmedFrame;
+    pendingConfirmedFrame = nullptr;
+}
+
+void LoRaMac::startRetransmission()
+{
+    currentTxFrame = pendingConfirmedFrame;
+    pendingConfirmedFrame = nullptr;
+    numRetry++;
+    const auto &frame = currentTxFrame->peekAtFront<LoRaMacFrame>();
+    retransmissionAirtime += LoRaTransmitter::computeAirtime(currentTxFrame->getByteLength(), frame->getLoRaSF(), frame->getLoRaBW(), frame->getLoRaCR());
+}
+
+void LoRaMac::handleMissingAck()
+{
+    if (pendingConfirmedFrame == nullptr || endRetransmissionBackoff->isScheduled())
+        return;
+    if (retryCounter >= retryLimit) {
+        EV << "no ACK after " << retryCounter << " retransmissions, giving up\n";
+        numGivenUp++;
+        retryCounter = 0;
+        delete pendingConfirmedFrame;
+        pendingConfirmedFrame = nullptr;
+        return;
+    }
+    retryCounter++;
+    // 1% duty cycle: the band is closed for 99 airtimes after the frame
+    const auto &frame = pendingConfirmedFrame->peekAtFront<LoRaMacFrame>();
+    simtime_t airtime = LoRaTransmitter::computeAirtime(pendingConfirmedFrame->getByteLength(), frame->getLoRaSF(), frame->getLoRaBW(), frame->getLoRaCR());
+    scheduleAt(simTime() + 100 * airtime + par("retransmissionBackoff"), endRetransmissionBackoff);
+}
+
+void LoRaMac::handleAckOutsideRxWindows(const Ptr<const LoRaMacFrame> &frame)
+{
+    // the server sends an ACK it could not fit into RX1 or RX2 in a ping
+    // slot or, for class C, right away; other downlinks there say nothing
+    // about the pending frame
+    if (pendingConfirmedFrame == nullptr || !isAck(frame))
+        return;
+    // the missing ACK in the RX windows already scheduled a retransmission
+    // that is not needed any more
+    if (endRetransmissionBackoff->isScheduled()) {
+        cancelEvent(endRetransmissionBackoff);
+        retryCounter--;
+    }
+    handleAck(frame);
+}
+
 Packet *LoRaMac::getCurrentTransmission()
 {
     ASSERT(currentTxFrame != nullptr);
@@ -518,7 +694,7 @@ bool LoRaMac::isReceiving()
 
 bool LoRaMac::isAck(const Ptr<const LoRaMacFrame> &frame)
 {
-    return false;//dynamic_cast<LoRaMacFrame *>(frame);
+    return frame->getAck();
 }
 
 bool LoRaMac::isBroadcast(const Ptr<const LoRaMacFrame> &frame)
@@ -538,6 +714,116 @@ void LoRaMac::turnOnReceiver()
     loraRadio->setRadioMode(IRadio::RADIO_MODE_RECEIVER);
 }
 
+void LoRaMac::turnOnIdleReceiver()
+{
+    // class C keeps the RX2 receiver on between uplinks
+    if (deviceClass == CLASS_C)
+        turnOnReceiver();
+    else
+        turnOffReceiver();
+}
+
+void LoRaMac::scheduleRxWindowBoundary()
+{
+    // only the boundary that ends the current state is in the FES
+    simtime_t boundary;
+    switch (fsm.getState()) {
+        case WAIT_DELAY_1:
+            turnOffReceiver();
+            boundary = rxWindowsStart + receiveDelay1;
+            break;
+        case LISTENING_1:
+            openRxWindow();
+            boundary = rxWindowsStart + receiveDelay1 + receiveWindow1Length;
+            break;
+        case WAIT_DELAY_2:
+            closeRxWindow();
+            boundary = rxWindowsStart + receiveDelay2;
+            break;
+        case LISTENING_2:
+            openRxWindow();
+            boundary = rxWindowsStart + receiveDelay2 + receiveWindow2Length;
+            break;
+        default:
+            throw cRuntimeError("No RX window boundary in state %d", fsm.getState());
+    }
+    // re-entering a window after a lost reception keeps its original end
+    if (!rxWindowTimer->isScheduled())
+        scheduleAt(std::max(boundary, simTime()), rxWindowTimer);
+}
+
+void LoRaMac::openRxWindow()
+{
+    if (analyticalRxWindows && !downlinkPending) {
+        // nothing queued for us: keep sleeping and account the window
+        if (analyticalListeningStart < SIMTIME_ZERO) {
+            analyticalListeningStart = simTime();
+            numAnalyticalRxWindows++;
+            if (energyConsumer != nullptr)
+                energyConsumer->startAnalyticalListening();
+        }
+    }
+    else
+        turnOnReceiver();
+}
+
+void LoRaMac::closeRxWindow()
+{
+    if (analyticalListeningStart >= SIMTIME_ZERO)
+        accountAnalyticalListening();
+    turnOffReceiver();
+}
+
+void LoRaMac::accountAnalyticalListening()
+{
+    simtime_t duration = simTime() - analyticalListeningStart;
+    analyticalListeningStart = -1;
+    analyticalListeningTime += duration;
+    if (energyConsumer != nullptr)
+        energyConsumer->endAnalyticalListening();
+}
+
+void LoRaMac::handlePendingDownlink()
+{
+    downlinkPending = true;
+    // the signal arrives after the propagation delay, so the receiver is on
+    // in time
+    if (analyticalListeningStart >= SIMTIME_ZERO) {
+        accountAnalyticalListening();
+        turnOnReceiver();
+    }
+}
+
+void LoRaMac::scheduleNextPingSlot()
+{
+    scheduleAt(computeNextPingSlot(address, pingSlotPeriodicity, simTime()), pingSlotStart);
+}
+
+simtime_t LoRaMac::computeNextPingSlot(const MacAddress& address, int pingSlotPeriodicity, simtime_t time)
+{
+    // LoRaWAN class B: beacons every 128 s, ping slots of 30 ms after the
+    // 2.12 s beacon reserved time, pingPeriod slots apart from an offset
+    // that is pseudo-random per beacon period and device address
+    const simtime_t beaconPeriod = 128;
+    const simtime_t beaconReserved = 2.12;
+    const simtime_t slotLength = 0.03;
+    const int pingNb = 1 << (7 - pingSlotPeriodicity);
+    const int pingPeriod = 4096 / pingNb;
+    static const LoRaCounterRng offsetRng(0);
+    // the slots of a beacon period all end before the next beacon, so the
+    // search starts in the period that contains time
+    for (long beaconIndex = (long)floor(time / beaconPeriod); ; beaconIndex++) {
+        double u1, u2;
+        offsetRng.uniform2(beaconIndex, address.getInt(), u1, u2);
+        int pingOffset = (int)(u1 * pingPeriod);
+        for (int pingSlotIndex = 0; pingSlotIndex < pingNb; pingSlotIndex++) {
+            simtime_t slotStart = beaconIndex * beaconPeriod + beaconReserved + (pingOffset + pingSlotIndex * pingPeriod) * slotLength;
+            if (slotStart > time)
+                return slotStart;
+        }
+    }
+}
+
 void LoRaMac::turnOffReceiver()
 {
     LoRaRadio *loraRadio;
@@ -1,6 +1,8 @@
 #ifndef __LORAMAC_H
 #define __LORAMAC_H
 
+#include <map>
+
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadio.h"
 #include "inet/linklayer/contract/IMacProtocol.h"
 #include "inet/linklayer/base/MacProtocolBase.h"
@@ -19,6 +21,8 @@ namespace flora {
 
 using namespace physicallayer;
 
+class LoRaEnergyConsumer;
+
 /**
  * Based on CSMA class
  */
@@ -42,18 +46,38 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
     simtime_t slotTime = -1;
     simtime_t sifsTime = -1;
     simtime_t difsTime = -1;
-    simtime_t waitDelay1Time = -1;
-    simtime_t listening1Time = -1;
-    simtime_t waitDelay2Time = -1;
-    simtime_t listening2Time = -1;
+    simtime_t receiveDelay1 = -1;
+    simtime_t receiveDelay2 = -1;
+    simtime_t receiveWindow1Length = -1;
+    simtime_t receiveWindow2Length = -1;
     int maxQueueSize = -1;
     int retryLimit = -1;
     int cwMin = -1;
     int cwMax = -1;
     int cwMulticast = -1;
     int sequenceNumber = 0;
+    bool confirmedUplinks = false;
+    enum DeviceClass { CLASS_A, CLASS_B, CLASS_C } deviceClass = CLASS_A;
+    int pingSlotPeriodicity = -1;
+    simtime_t pingSlotDuration = -1;
+    bool analyticalRxWindows = false;
     //@}
 
+    /** Energy consumer that accounts the analytical RX windows, if any */
+    LoRaEnergyConsumer *energyConsumer = nullptr;
+
+    /** Class B ping slot schedule */
+    //@{
+    cMessage *pingSlotStart = nullptr;
+    cMessage *pingSlotEnd = nullptr;
+    //@}
+
+    /** Confirmed uplink waiting for its ACK, nullptr if none */
+    Packet *pendingConfirmedFrame = nullptr;
+
+    /** End of the backoff before retransmitting the confirmed uplink */
+    cMessage *endRetransmissionBackoff = nullptr;
+
     /** End of the Short Inter-Frame Time period */
     cMessage *endSifs = nullptr;
 
@@ -80,6 +104,8 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
         WAIT_DELAY_2,
         LISTENING_2,
         RECEIVING_2,
+        PING_SLOT,
+        RECEIVING_DOWNLINK,
     };
 
     IRadio *radio = nullptr;
@@ -112,17 +138,17 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
     /** Timeout after the reception of a Data frame */
     cMessage *droppedPacket = nullptr;
 
-    /** End of the Delay_1 */
-    cMessage *endDelay_1 = nullptr;
+    /** Next RX1/RX2 boundary, rescheduled on every state of the window sequence */
+    cMessage *rxWindowTimer = nullptr;
 
-    /** End of the Listening_1 */
-    cMessage *endListening_1 = nullptr;
+    /** End of the last uplink, the RX windows are relative to it */
+    simtime_t rxWindowsStart;
 
-    /** End of the Delay_2 */
-    cMessage *endDelay_2 = nullptr;
+    /** The network server queued a downlink after the last uplink */
+    bool downlinkPending = false;
 
-    /** End of the Listening_2 */
-    cMessage *endListening_2 = nullptr;
+    /** Start of the RX window being accounted analytically, -1 if none */
+    simtime_t analyticalListeningStart = -1;
 
     /** Radio state change self message. Currently this is optimized away and sent directly */
     cMessage *mediumStateChange = nullptr;
@@ -138,6 +164,10 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
     long numReceived;
     long numSentBroadcast;
     long numReceivedBroadcast;
+    long numAcked;
+    simtime_t retransmissionAirtime;
+    long numAnalyticalRxWindows;
+    simtime_t analyticalListeningTime;
     //@}
 
   public:
@@ -152,6 +182,9 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
     virtual void handleCanPullPacketChanged(cGate *gate) override;
     virtual void handlePullPacketProcessed(Packet *packet, cGate *gate, bool successful) override;
 
+    /** Start of the first class B ping slot of address after time. */
+    static simtime_t computeNextPingSlot(const MacAddress& address, int pingSlotPeriodicity, simtime_t time);
+
   protected:
     /**
      * @name Initialization functions
@@ -198,6 +231,10 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
      */
     //@{
     virtual void finishCurrentTransmission();
+    virtual void handleAck(const Ptr<const LoRaMacFrame> &frame);
+    virtual void handleMissingAck();
+    virtual void handleAckOutsideRxWindows(const Ptr<const LoRaMacFrame> &frame);
+    virtual void startRetransmission();
     virtual Packet *getCurrentTransmission();
 
     virtual bool isReceiving();
@@ -207,6 +244,14 @@ class LoRaMac : public MacProtocolBase, public IMacProtocol, public queueing::IA
 
     void turnOnReceiver(void);
     void turnOffReceiver(void);
+    void turnOnIdleReceiver(void);
+    void scheduleRxWindowBoundary();
+    void openRxWindow();
+    void closeRxWindow();
+    void accountAnalyticalListening();
+    /** A downlink to this device is starting at a gateway. */
+    virtual void handlePendingDownlink();
+    virtual void scheduleNextPingSlot();
     virtual void processUpperPacket();
     //@}
 };
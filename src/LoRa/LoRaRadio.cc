@@ -38,6 +38,7 @@ simsignal_t LoRaRadio::packetErrorRateSignal = cComponent::registerSignal("packe
 simsignal_t LoRaRadio::bitErrorRateSignal = cComponent::registerSignal("bitErrorRate");
 simsignal_t LoRaRadio::symbolErrorRateSignal = cComponent::registerSignal("symbolErrorRate");
 simsignal_t LoRaRadio::droppedPacket = cComponent::registerSignal("droppedPacket");
+simsignal_t LoRaRadio::downlinkAnnouncedSignal = cComponent::registerSignal("downlinkAnnounced");
 
 
 void LoRaRadio::initialize(int stage)
@@ -517,6 +518,12 @@ void LoRaRadio::sendUp(Packet *macFrame)
     //send(macFrame, upperLayerOut);
 }
 
+void LoRaRadio::announceDownlink()
+{
+    Enter_Method("announceDownlink");
+    emit(downlinkAnnouncedSignal, 0);
+}
+
 //double LoRaRadio::getCurrentTxPower()
 //{
 //    return currentTxPower;
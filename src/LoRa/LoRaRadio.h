@@ -37,6 +37,7 @@ public:
   static simsignal_t bitErrorRateSignal;
   static simsignal_t symbolErrorRateSignal;
   static simsignal_t droppedPacket;
+  static simsignal_t downlinkAnnouncedSignal;
 
 public:
   /**
@@ -105,6 +106,12 @@ public:
 
   virtual int getId() const override { return id; }
 
+  /**
+   * Called by the medium when a gateway starts a downlink addressed to this
+   * radio, before the signal arrives here.
+   */
+  virtual void announceDownlink();
+
   virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
 
   virtual const IAntenna *getAntenna() const override { return antenna; }
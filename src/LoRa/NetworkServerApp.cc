@@ -14,6 +14,7 @@
 // 
 
 #include "NetworkServerApp.h"
+#include "LoRaMac.h"
 //#include "inet/networklayer/ipv4/IPv4Datagram.h"
 //#include "inet/networklayer/contract/ipv4/IPv4ControlInfo.h"
 #include "inet/networklayer/common/L3AddressTag_m.h"
@@ -39,6 +40,14 @@ void NetworkServerApp::initialize(int stage)
         localPort = par("localPort");
         destPort = par("destPort");
         adrMethod = par("adrMethod").stdstringValue();
+        scheduleDownlinks = par("scheduleDownlinks");
+        receiveDelay1 = par("receiveDelay1");
+        receiveDelay2 = par("receiveDelay2");
+        receiveWindowLength = par("receiveWindowLength");
+        deviceClass = par("deviceClass").stdstringValue();
+        if (deviceClass != "A" && deviceClass != "B" && deviceClass != "C")
+            throw cRuntimeError("Unknown device class '%s'", deviceClass.c_str());
+        pingSlotPeriodicity = par("pingSlotPeriodicity");
     } else if (stage == INITSTAGE_APPLICATION_LAYER) {
         startUDP();
         getSimulation()->getSystemModule()->subscribe("LoRa_AppPacketSent", this);
@@ -79,7 +88,10 @@ void NetworkServerApp::handleMessage(cMessage *msg)
         processLoraMACPacket(pkt);
     }
     else if(msg->isSelfMessage()) {
-        processScheduledPacket(msg);
+        if (!strcmp(msg->getName(), "downlinkSendTimer"))
+            sendScheduledDownlink(msg);
+        else
+            processScheduledPacket(msg);
     }
 }
 
@@ -113,6 +125,15 @@ void NetworkServerApp::finish()
 
     receivedRSSI.recordAs("receivedRSSI");
     recordScalar("totalReceivedPackets", totalReceivedPackets);
+    if (scheduleDownlinks) {
+        recordScalar("downlinksSentRX1", downlinksSentRX1);
+        recordScalar("downlinksSentRX2", downlinksSentRX2);
+        if (deviceClass != "A")
+            recordScalar("downlinksSentOutsideRxWindows", downlinksSentOutsideRxWindows);
+        recordScalar("downlinksDropped", downlinksDropped);
+    }
+    recordScalar("acksSent", acksSent);
+    recordScalar("duplicateUplinks", duplicateUplinks);
 
     while(!receivedPackets.empty()) {
         receivedPackets.back().endOfWaiting->removeControlInfo();
@@ -125,7 +146,14 @@ void NetworkServerApp::finish()
         receivedPackets.pop_back();
     }
 
+    while(!scheduledDownlinks.empty()) {
+        delete scheduledDownlinks.back().pkt;
+        cancelAndDelete(scheduledDownlinks.back().sendTimer);
+        scheduledDownlinks.pop_back();
+    }
+
     knownNodes.clear();
+    knownGateways.clear();
     receivedPackets.clear();
 
     recordScalar("counterUniqueReceivedPacketsPerSF SF7", counterUniqueReceivedPacketsPerSF[0]);
@@ -235,6 +263,7 @@ void NetworkServerApp::addPktToProcessingTable(Packet* pkt)
         rcvPkt.rcvdPacket = pkt;
         rcvPkt.endOfWaiting = new cMessage("endOfWaitingWindow");
         rcvPkt.endOfWaiting->setControlInfo(pkt);
+        rcvPkt.arrivalTime = simTime();
         const auto& networkHeader = getNetworkProtocolHeader(pkt);
         const L3Address& gwAddress = networkHeader->getSourceAddress();
         rcvPkt.possibleGateways.emplace_back(gwAddress, frame->getSNIR(), frame->getRSSI());
@@ -249,7 +278,20 @@ void NetworkServerApp::processScheduledPacket(cMessage* selfMsg)
     auto pkt = check_and_cast<Packet *>(selfMsg->removeControlInfo());
     const auto & frame = pkt->peekAtFront<LoRaMacFrame>();
 
-    if (simTime() >= getSimulation()->getWarmupPeriod())
+    // a retransmission of an uplink that was delivered already, because its
+    // ACK got lost, is only acknowledged again
+    bool duplicate = false;
+    for (auto &elem : knownNodes) {
+        if (elem.srcAddr == frame->getTransmitterAddress()) {
+            duplicate = frame->getConfirmed() && elem.lastSeqNoDelivered == frame->getSequenceNumber();
+            elem.lastSeqNoDelivered = frame->getSequenceNumber();
+        }
+    }
+    bool countStatistics = simTime() >= getSimulation()->getWarmupPeriod();
+    if (duplicate && countStatistics)
+        duplicateUplinks++;
+
+    if (countStatistics && !duplicate)
     {
         counterUniqueReceivedPacketsPerSF[frame->getLoRaSF()-7]++;
     }
@@ -264,12 +306,8 @@ void NetworkServerApp::processScheduledPacket(cMessage* selfMsg)
         if(frameAux->getTransmitterAddress() == frame->getTransmitterAddress() && frameAux->getSequenceNumber() == frame->getSequenceNumber())        {
             packetNumber = i;
             nodeNumber = frame->getTransmitterAddress().getInt();
-            if (numReceivedPerNode.count(nodeNumber-1)>0)
-            {
+            if (!duplicate)
                 ++numReceivedPerNode[nodeNumber-1];
-            } else {
-                numReceivedPerNode[nodeNumber-1] = 1;
-            }
 
             for(uint j=0;j<receivedPackets[i].possibleGateways.size();j++)
             {
@@ -282,22 +320,27 @@ void NetworkServerApp::processScheduledPacket(cMessage* selfMsg)
             }
         }
     }
-    emit(LoRa_ServerPacketReceived, true);
-    if (simTime() >= getSimulation()->getWarmupPeriod())
-    {
-        counterUniqueReceivedPackets++;
-    }
-    receivedRSSI.collect(frame->getRSSI());
-    if(evaluateADRinServer)
-    {
-        evaluateADR(pkt, pickedGateway, SNIRinGW, RSSIinGW);
+    bool downlinkSent = false;
+    if (!duplicate) {
+        emit(LoRa_ServerPacketReceived, true);
+        if (countStatistics)
+        {
+            counterUniqueReceivedPackets++;
+        }
+        receivedRSSI.collect(frame->getRSSI());
+        if(evaluateADRinServer)
+        {
+            downlinkSent = evaluateADR(pkt, receivedPackets[packetNumber], pickedGateway, SNIRinGW, RSSIinGW);
+        }
     }
+    if (frame->getConfirmed() && !downlinkSent)
+        sendAck(frame, receivedPackets[packetNumber], pickedGateway);
     delete receivedPackets[packetNumber].rcvdPacket;
     delete selfMsg;
     receivedPackets.erase(receivedPackets.begin()+packetNumber);
 }
 
-void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double SNIRinGW, double RSSIinGW)
+bool NetworkServerApp::evaluateADR(Packet* pkt, const receivedPacket &uplink, L3Address pickedGateway, double SNIRinGW, double RSSIinGW)
 {
     bool sendADR = false;
     bool sendADRAckRep = false;
@@ -422,16 +465,200 @@ void NetworkServerApp::evaluateADR(Packet* pkt, L3Address pickedGateway, double
         frameToSend->setLoRaCF(frame->getLoRaCF());
         frameToSend->setLoRaSF(frame->getLoRaSF());
         frameToSend->setLoRaBW(frame->getLoRaBW());
+        // piggyback the ACK of a confirmed uplink
+        frameToSend->setAck(frame->getConfirmed());
 
         auto pktAux = new Packet("ADRPacket");
         mgmtPacket->setChunkLength(B(par("headerLength").intValue()));
 
         pktAux->insertAtFront(mgmtPacket);
         pktAux->insertAtFront(frameToSend);
-        socket.sendTo(pktAux, pickedGateway, destPort);
-
+        sendDownlink(pktAux, uplink, pickedGateway);
+        return true;
     }
     //delete pkt;
+    return false;
+}
+
+void NetworkServerApp::sendAck(const Ptr<const LoRaMacFrame> &frame, const receivedPacket &uplink, L3Address pickedGateway)
+{
+    auto ackFrame = makeShared<LoRaMacFrame>();
+    ackFrame->setChunkLength(B(par("headerLength").intValue()));
+    ackFrame->setReceiverAddress(frame->getTransmitterAddress());
+    ackFrame->setLoRaTP(math::dBmW2mW(14));
+    ackFrame->setLoRaCF(frame->getLoRaCF());
+    ackFrame->setLoRaSF(frame->getLoRaSF());
+    ackFrame->setLoRaBW(frame->getLoRaBW());
+    ackFrame->setAck(true);
+
+    auto ackPacket = new Packet("AckPacket");
+    ackPacket->insertAtFront(ackFrame);
+    sendDownlink(ackPacket, uplink, pickedGateway);
+}
+
+knownGW& NetworkServerApp::getKnownGateway(const L3Address &address)
+{
+    for (auto &elem : knownGateways) {
+        if (elem.ipAddr == address)
+            return elem;
+    }
+    knownGW newGateway;
+    newGateway.ipAddr = address;
+    knownGateways.push_back(newGateway);
+    return knownGateways.back();
+}
+
+bool NetworkServerApp::isGatewayAvailable(knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta)
+{
+    // the gateway MAC drops every downlink handed to it during the duty-cycle
+    // off-time of the previous one, so mirror that rule here
+    simtime_t txEnd = txTime + dutyCycleDelta;
+    auto it = gateway.reservedDownlinks.begin();
+    while (it != gateway.reservedDownlinks.end()) {
+        if (it->second <= simTime())
+            it = gateway.reservedDownlinks.erase(it);
+        else {
+            if (txTime < it->second && it->first < txEnd)
+                return false;
+            ++it;
+        }
+    }
+    return true;
+}
+
+void NetworkServerApp::sendDownlink(Packet *downlink, const receivedPacket &uplink, L3Address pickedGateway)
+{
+    bool countStatistics = simTime() >= getSimulation()->getWarmupPeriod();
+    if (!scheduleDownlinks) {
+        if (countStatistics && downlink->peekAtFront<LoRaMacFrame>()->getAck())
+            acksSent++;
+        socket.sendTo(downlink, pickedGateway, destPort);
+        return;
+    }
+
+    // candidate gateways are the ones that heard the uplink, best SNIR first
+    auto gateways = uplink.possibleGateways;
+    std::stable_sort(gateways.begin(), gateways.end(), [] (const std::tuple<L3Address, double, double> &a, const std::tuple<L3Address, double, double> &b) {
+        return std::get<1>(a) > std::get<1>(b);
+    });
+
+    simtime_t rx1Start = uplink.arrivalTime + receiveDelay1;
+    simtime_t rx2Start = uplink.arrivalTime + receiveDelay2;
+    // the gateway MAC computes the same off-time from the same frame
+    simtime_t dutyCycleDelta = LoRaGWMac::getDutyCycleDelta(downlink);
+
+    // RX1: transmit right away if the window is still open
+    if (simTime() < rx1Start + receiveWindowLength) {
+        simtime_t txTime = std::max(simTime(), rx1Start);
+        for (auto &elem : gateways) {
+            knownGW &gateway = getKnownGateway(std::get<0>(elem));
+            if (isGatewayAvailable(gateway, txTime, dutyCycleDelta)) {
+                if (countStatistics)
+                    downlinksSentRX1++;
+                scheduleDownlink(downlink, gateway, txTime, dutyCycleDelta);
+                return;
+            }
+        }
+    }
+
+    // RX2: reserve the best gateway that will be free when the window opens
+    if (simTime() <= rx2Start) {
+        for (auto &elem : gateways) {
+            knownGW &gateway = getKnownGateway(std::get<0>(elem));
+            if (isGatewayAvailable(gateway, rx2Start, dutyCycleDelta)) {
+                if (countStatistics)
+                    downlinksSentRX2++;
+                scheduleDownlink(downlink, gateway, rx2Start, dutyCycleDelta);
+                return;
+            }
+        }
+    }
+
+    // class B and C devices are back in IDLE after RX2 and listen there
+    if (deviceClass != "A" && sendOutsideRxWindows(downlink, gateways, std::max(simTime(), rx2Start + receiveWindowLength), dutyCycleDelta)) {
+        if (countStatistics)
+            downlinksSentOutsideRxWindows++;
+        return;
+    }
+
+    EV << "No gateway available in RX1 or RX2, dropping downlink " << downlink->getName() << endl;
+    if (countStatistics)
+        downlinksDropped++;
+    delete downlink;
+}
+
+bool NetworkServerApp::sendOutsideRxWindows(Packet *downlink, const std::vector<std::tuple<L3Address, double, double>> &gateways, simtime_t earliest, simtime_t dutyCycleDelta)
+{
+    if (gateways.empty())
+        return false;
+    if (deviceClass == "C") {
+        // the receiver is always on: take the gateway that is free first
+        L3Address bestGateway;
+        simtime_t bestTime = -1;
+        for (auto &elem : gateways) {
+            simtime_t txTime = getGatewayFreeTime(getKnownGateway(std::get<0>(elem)), earliest, dutyCycleDelta);
+            if (bestTime < SIMTIME_ZERO || txTime < bestTime) {
+                bestGateway = std::get<0>(elem);
+                bestTime = txTime;
+            }
+        }
+        scheduleDownlink(downlink, getKnownGateway(bestGateway), bestTime, dutyCycleDelta);
+        return true;
+    }
+    // class B: the first ping slot in which one of the gateways is free;
+    // reservations are finite, so such a slot always exists
+    MacAddress address = downlink->peekAtFront<LoRaMacFrame>()->getReceiverAddress();
+    for (simtime_t slot = LoRaMac::computeNextPingSlot(address, pingSlotPeriodicity, earliest); ; slot = LoRaMac::computeNextPingSlot(address, pingSlotPeriodicity, slot)) {
+        for (auto &elem : gateways) {
+            knownGW &gateway = getKnownGateway(std::get<0>(elem));
+            if (isGatewayAvailable(gateway, slot, dutyCycleDelta)) {
+                scheduleDownlink(downlink, gateway, slot, dutyCycleDelta);
+                return true;
+            }
+        }
+    }
+}
+
+simtime_t NetworkServerApp::getGatewayFreeTime(knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta)
+{
+    // push the start past every reservation it overlaps with
+    while (!isGatewayAvailable(gateway, txTime, dutyCycleDelta)) {
+        for (auto &elem : gateway.reservedDownlinks) {
+            if (txTime < elem.second && elem.first < txTime + dutyCycleDelta)
+                txTime = elem.second;
+        }
+    }
+    return txTime;
+}
+
+void NetworkServerApp::scheduleDownlink(Packet *downlink, knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta)
+{
+    // dropped downlinks never get here, so only delivered ACKs are counted
+    if (simTime() >= getSimulation()->getWarmupPeriod() && downlink->peekAtFront<LoRaMacFrame>()->getAck())
+        acksSent++;
+    gateway.reservedDownlinks.emplace_back(txTime, txTime + dutyCycleDelta);
+    if (txTime == simTime())
+        socket.sendTo(downlink, gateway.ipAddr, destPort);
+    else {
+        scheduledDownlink entry;
+        entry.pkt = downlink;
+        entry.gateway = gateway.ipAddr;
+        entry.sendTimer = new cMessage("downlinkSendTimer");
+        scheduleAt(txTime, entry.sendTimer);
+        scheduledDownlinks.push_back(entry);
+    }
+}
+
+void NetworkServerApp::sendScheduledDownlink(cMessage *sendTimer)
+{
+    for (auto it = scheduledDownlinks.begin(); it != scheduledDownlinks.end(); ++it) {
+        if (it->sendTimer == sendTimer) {
+            socket.sendTo(it->pkt, it->gateway, destPort);
+            scheduledDownlinks.erase(it);
+            break;
+        }
+    }
+    delete sendTimer;
 }
 
 void NetworkServerApp::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details)
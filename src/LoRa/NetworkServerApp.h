@@ -28,6 +28,7 @@
 #include "inet/applications/base/ApplicationBase.h"
 #include "inet/transportlayer/contract/udp/UdpSocket.h"
 #include "../LoRaApp/LoRaAppPacket_m.h"
+#include "LoRaGWMac.h"
 #include <list>
 
 namespace flora {
@@ -38,6 +39,7 @@ public:
     MacAddress srcAddr;
     int framesFromLastADRCommand;
     int lastSeqNoProcessed;
+    int lastSeqNoDelivered = -1; // retransmissions of it are only acknowledged
     int numberOfSentADRPackets;
     std::list<double> adrListSNIR;
     cOutVector *historyAllSNIR;
@@ -50,6 +52,7 @@ class knownGW
 {
 public:
     L3Address ipAddr;
+    std::list<std::pair<simtime_t, simtime_t>> reservedDownlinks; // <start, end of duty-cycle off-time>
 };
 
 class receivedPacket
@@ -57,9 +60,18 @@ class receivedPacket
 public:
     Packet* rcvdPacket = nullptr;
     cMessage* endOfWaiting = nullptr;
+    simtime_t arrivalTime;
     std::vector<std::tuple<L3Address, double, double>> possibleGateways; // <address, sinr, rssi>
 };
 
+class scheduledDownlink
+{
+public:
+    Packet* pkt = nullptr;
+    cMessage* sendTimer = nullptr;
+    L3Address gateway;
+};
+
 class NetworkServerApp : public cSimpleModule, cListener
 {
   public:
@@ -68,6 +80,7 @@ class NetworkServerApp : public cSimpleModule, cListener
     std::vector<knownNode> knownNodes;
     std::vector<knownGW> knownGateways;
     std::vector<receivedPacket> receivedPackets;
+    std::vector<scheduledDownlink> scheduledDownlinks;
     int localPort = -1, destPort = -1;
     std::vector<std::tuple<MacAddress, int>> recvdPackets;
     // state
@@ -78,6 +91,20 @@ class NetworkServerApp : public cSimpleModule, cListener
     double adrDeviceMargin;
     std::map<int, int> numReceivedPerNode;
 
+    // downlink scheduling
+    bool scheduleDownlinks;
+    simtime_t receiveDelay1;
+    simtime_t receiveDelay2;
+    simtime_t receiveWindowLength;
+    std::string deviceClass;
+    int pingSlotPeriodicity = -1;
+    long downlinksSentRX1 = 0;
+    long downlinksSentRX2 = 0;
+    long downlinksSentOutsideRxWindows = 0;
+    long downlinksDropped = 0;
+    long acksSent = 0;
+    long duplicateUplinks = 0;
+
   protected:
     virtual void initialize(int stage) override;
     virtual void handleMessage(cMessage *msg) override;
@@ -90,7 +117,15 @@ class NetworkServerApp : public cSimpleModule, cListener
     void updateKnownNodes(Packet* pkt);
     void addPktToProcessingTable(Packet* pkt);
     void processScheduledPacket(cMessage* selfMsg);
-    void evaluateADR(Packet *pkt, L3Address pickedGateway, double SNIRinGW, double RSSIinGW);
+    bool evaluateADR(Packet *pkt, const receivedPacket &uplink, L3Address pickedGateway, double SNIRinGW, double RSSIinGW);
+    void sendAck(const Ptr<const LoRaMacFrame> &frame, const receivedPacket &uplink, L3Address pickedGateway);
+    void sendDownlink(Packet *downlink, const receivedPacket &uplink, L3Address pickedGateway);
+    void sendScheduledDownlink(cMessage *sendTimer);
+    knownGW& getKnownGateway(const L3Address &address);
+    bool isGatewayAvailable(knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta);
+    simtime_t getGatewayFreeTime(knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta);
+    void scheduleDownlink(Packet *downlink, knownGW &gateway, simtime_t txTime, simtime_t dutyCycleDelta);
+    bool sendOutsideRxWindows(Packet *downlink, const std::vector<std::tuple<L3Address, double, double>> &gateways, simtime_t earliest, simtime_t dutyCycleDelta);
     void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
     bool evaluateADRinServer;
 
@@ -101,6 +101,10 @@ void PacketForwarder::handleMessage(cMessage *msg)
         pkt->setCodeRendundance(loRaCR);
         pkt->setPower(W(loRaTP));*/
 
+        if (simTime() >= getSimulation()->getWarmupPeriod()) {
+            backhaulDownlinkPackets++;
+            backhaulDownlinkBytes += pkt->getByteLength();
+        }
         send(pkt, "lowerLayerOut");
         //
     }
@@ -134,6 +138,10 @@ void PacketForwarder::processLoraMACPacket(Packet *pk)
     if (pk->getControlInfo())
        delete pk->removeControlInfo();
 
+    if (simTime() >= getSimulation()->getWarmupPeriod()) {
+        backhaulUplinkPackets++;
+        backhaulUplinkBytes += pk->getByteLength();
+    }
     socket.sendTo(pk, destAddr, destPort);
 }
 
@@ -165,6 +173,10 @@ void PacketForwarder::receiveSignal(cComponent *source, simsignal_t signalID, in
 void PacketForwarder::finish()
 {
     recordScalar("LoRa_GW_DER", double(counterOfReceivedPackets)/counterOfSentPacketsFromNodes);
+    recordScalar("backhaulUplinkPackets", backhaulUplinkPackets);
+    recordScalar("backhaulUplinkBytes", backhaulUplinkBytes, "B");
+    recordScalar("backhaulDownlinkPackets", backhaulDownlinkPackets);
+    recordScalar("backhaulDownlinkBytes", backhaulDownlinkBytes, "B");
 }
 
 
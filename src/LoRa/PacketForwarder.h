@@ -53,6 +53,11 @@ class PacketForwarder : public cSimpleModule, public cListener
       simsignal_t LoRa_GWPacketReceived;
       int counterOfSentPacketsFromNodes = 0;
       int counterOfReceivedPackets = 0;
+      // UDP packets and payload bytes exchanged with the network server after the warm-up
+      long backhaulUplinkPackets = 0;
+      long backhaulUplinkBytes = 0;
+      long backhaulDownlinkPackets = 0;
+      long backhaulDownlinkBytes = 0;
 };
 } //namespace inet
 #endif
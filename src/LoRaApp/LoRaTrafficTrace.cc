@@ -0,0 +1,101 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include "LoRaTrafficTrace.h"
+
+#include <omnetpp.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace omnetpp;
+
+namespace flora {
+
+std::map<std::string, LoRaTrafficTrace *> LoRaTrafficTrace::openTraces;
+
+LoRaTrafficTrace::LoRaTrafficTrace(const char *fileName) :
+    fileName(fileName)
+{
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd == -1)
+        throw cRuntimeError("Cannot open traffic trace '%s'", fileName);
+    struct stat status;
+    if (fstat(fd, &status) == -1 || status.st_size < (off_t)sizeof(Header)) {
+        ::close(fd);
+        throw cRuntimeError("Traffic trace '%s' is too short", fileName);
+    }
+    mappingSize = status.st_size;
+    void *address = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        throw cRuntimeError("Cannot map traffic trace '%s'", fileName);
+    mapping = static_cast<const char *>(address);
+
+    const Header *header = reinterpret_cast<const Header *>(mapping);
+    if (memcmp(header->magic, "FLORATRC", 8) != 0 || header->version != 1) {
+        munmap(const_cast<char *>(mapping), mappingSize);
+        throw cRuntimeError("'%s' is not a version 1 traffic trace", fileName);
+    }
+    numDevices = header->numDevices;
+    size_t recordsOffset = sizeof(Header) + (size_t)numDevices * sizeof(DeviceIndex);
+    if (recordsOffset > mappingSize) {
+        munmap(const_cast<char *>(mapping), mappingSize);
+        throw cRuntimeError("Traffic trace '%s' is truncated in the device index", fileName);
+    }
+    devices = reinterpret_cast<const DeviceIndex *>(mapping + sizeof(Header));
+    records = reinterpret_cast<const Record *>(mapping + recordsOffset);
+    // only the index is touched here, the records stay on disk until replayed
+    uint64_t numRecords = (mappingSize - recordsOffset) / sizeof(Record);
+    for (uint32_t i = 0; i < numDevices; i++) {
+        if (devices[i].firstRecord > numRecords || devices[i].numRecords > numRecords - devices[i].firstRecord) {
+            munmap(const_cast<char *>(mapping), mappingSize);
+            throw cRuntimeError("Traffic trace '%s' is truncated at device %u", fileName, i);
+        }
+    }
+}
+
+LoRaTrafficTrace::~LoRaTrafficTrace()
+{
+    munmap(const_cast<char *>(mapping), mappingSize);
+}
+
+LoRaTrafficTrace *LoRaTrafficTrace::open(const char *fileName)
+{
+    LoRaTrafficTrace *& trace = openTraces[fileName];
+    if (trace == nullptr) {
+        try {
+            trace = new LoRaTrafficTrace(fileName);
+        }
+        catch (...) {
+            openTraces.erase(fileName);
+            throw;
+        }
+    }
+    trace->referenceCount++;
+    return trace;
+}
+
+void LoRaTrafficTrace::release(LoRaTrafficTrace *trace)
+{
+    if (--trace->referenceCount == 0) {
+        openTraces.erase(trace->fileName);
+        delete trace;
+    }
+}
+
+}
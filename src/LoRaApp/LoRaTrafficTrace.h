@@ -0,0 +1,86 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#ifndef LORAAPP_LORATRAFFICTRACE_H_
+#define LORAAPP_LORATRAFFICTRACE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace flora {
+
+/**
+ * Read-only memory mapping of a binary uplink trace, shared by all apps that
+ * replay the same file. Records are read in place, so the pages of a device
+ * are only loaded when its app reaches them.
+ *
+ * File layout (little endian):
+ *   header   char magic[8] = "FLORATRC", uint32 version = 1, uint32 numDevices
+ *   index    numDevices x { uint64 firstRecord, uint64 numRecords }
+ *   records  { double time [s], uint32 payloadSize [B], uint32 reserved }
+ *
+ * The records of each device are contiguous and sorted by time;
+ * simulations/trace_to_binary.py writes this format from a CSV export.
+ */
+class LoRaTrafficTrace
+{
+  public:
+    struct Record {
+        double time;
+        uint32_t payloadSize;
+        uint32_t reserved;
+    };
+
+  protected:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t numDevices;
+    };
+    struct DeviceIndex {
+        uint64_t firstRecord;
+        uint64_t numRecords;
+    };
+
+    std::string fileName;
+    int referenceCount = 0;
+    const char *mapping = nullptr;
+    size_t mappingSize = 0;
+    const DeviceIndex *devices = nullptr;
+    uint32_t numDevices = 0;
+    const Record *records = nullptr;
+
+    static std::map<std::string, LoRaTrafficTrace *> openTraces;
+
+  protected:
+    LoRaTrafficTrace(const char *fileName);
+    ~LoRaTrafficTrace();
+
+  public:
+    /** Maps the file, or shares the mapping another app opened already. */
+    static LoRaTrafficTrace *open(const char *fileName);
+    /** Unmaps the file when the last user releases it. */
+    static void release(LoRaTrafficTrace *trace);
+
+    uint32_t getNumDevices() const { return numDevices; }
+    uint64_t getNumRecords(uint32_t device) const { return devices[device].numRecords; }
+    const Record& getRecord(uint32_t device, uint64_t i) const { return records[devices[device].firstRecord + i]; }
+    const std::string& getFileName() const { return fileName; }
+};
+
+}
+
+#endif /* LORAAPP_LORATRAFFICTRACE_H_ */
@@ -17,12 +17,19 @@
 #include "inet/mobility/static/StationaryMobility.h"
 #include "../LoRa/LoRaTagInfo_m.h"
 #include "inet/common/packet/Packet.h"
+#include "LoRaPhy/LoRaTransmitter.h"
 
 
 namespace flora {
 
 Define_Module(SimpleLoRaApp);
 
+SimpleLoRaApp::~SimpleLoRaApp()
+{
+    if (trafficTrace != nullptr)
+        LoRaTrafficTrace::release(trafficTrace);
+}
+
 void SimpleLoRaApp::initialize(int stage)
 {
     cSimpleModule::initialize(stage);
@@ -43,15 +50,28 @@ void SimpleLoRaApp::initialize(int stage)
         isOperational = (!nodeStatus) || nodeStatus->getState() == NodeStatus::UP;
         if (!isOperational)
             throw cRuntimeError("This module doesn't support starting in node DOWN state");
-        do {
-            timeToFirstPacket = par("timeToFirstPacket");
-            EV << "Wylosowalem czas :" << timeToFirstPacket << endl;
-            //if(timeToNextPacket < 5) error("Time to next packet must be grater than 3");
-        } while(timeToFirstPacket <= 5);
-
-        //timeToFirstPacket = par("timeToFirstPacket");
-        sendMeasurements = new cMessage("sendMeasurements");
-        scheduleAt(simTime()+timeToFirstPacket, sendMeasurements);
+        const char *traceFile = par("trafficTrace");
+        if (strcmp(traceFile, "") != 0) {
+            trafficTrace = LoRaTrafficTrace::open(traceFile);
+            int device = par("traceDeviceIndex");
+            if (device == -1)
+                device = getContainingNode(this)->getIndex();
+            if (device < 0 || (uint32_t)device >= trafficTrace->getNumDevices())
+                throw cRuntimeError("Device %d is not in traffic trace '%s'", device, traceFile);
+            traceDevice = device;
+            scheduleNextTracePacket();
+        }
+        else {
+            do {
+                timeToFirstPacket = par("timeToFirstPacket");
+                EV << "Wylosowalem czas :" << timeToFirstPacket << endl;
+                //if(timeToNextPacket < 5) error("Time to next packet must be grater than 3");
+            } while(timeToFirstPacket <= 5);
+
+            //timeToFirstPacket = par("timeToFirstPacket");
+            sendMeasurements = new cMessage("sendMeasurements");
+            scheduleAt(simTime()+timeToFirstPacket, sendMeasurements);
+        }
 
         sentPackets = 0;
         receivedADRCommands = 0;
@@ -74,11 +94,55 @@ void SimpleLoRaApp::initialize(int stage)
 //        loRaUseHeader = par("initialUseHeader");
         loRaRadio->loRaUseHeader = par("initialUseHeader");
         evaluateADRinNode = par("evaluateADRinNode");
+        macHeaderLength = getParentModule()->getSubmodule("LoRaNic")->getSubmodule("mac")->par("headerLength").intValueInUnit("B");
+        initializeChannelPlan();
         sfVector.setName("SF Vector");
         tpVector.setName("TP Vector");
     }
 }
 
+void SimpleLoRaApp::initializeChannelPlan()
+{
+    const char *channelPlan = par("channelPlan");
+    if (!strcmp(channelPlan, ""))
+        return;
+    if (getBW() != units::values::Hz(125000))
+        throw cRuntimeError("Channel plan '%s' requires 125 kHz bandwidth", channelPlan);
+    if (!strcmp(channelPlan, "EU868")) {
+        for (int i = 0; i < 3; i++)
+            uplinkChannels.push_back(units::values::Hz(868100000 + i * 200000));
+    }
+    else if (!strcmp(channelPlan, "US915")) {
+        int subBand = par("usSubBand");
+        if (subBand != -1 && (subBand < 1 || subBand > 8))
+            throw cRuntimeError("Invalid US915 sub-band %d", subBand);
+        int first = subBand == -1 ? 0 : (subBand - 1) * 8;
+        int last = subBand == -1 ? 63 : first + 7;
+        for (int i = first; i <= last; i++)
+            uplinkChannels.push_back(units::values::Hz(902300000 + i * 200000));
+    }
+    else
+        throw cRuntimeError("Unknown channel plan '%s'", channelPlan);
+    setCF(uplinkChannels[0]);
+}
+
+bool SimpleLoRaApp::scheduleNextTracePacket()
+{
+    // one record is read per uplink, so only the pages being replayed are
+    // ever loaded from the trace
+    if (traceCursor >= trafficTrace->getNumRecords(traceDevice))
+        return false;
+    const LoRaTrafficTrace::Record& record = trafficTrace->getRecord(traceDevice, traceCursor++);
+    if (record.time < simTime().dbl())
+        throw cRuntimeError("Record %lu of device %u in traffic trace '%s' is not in time order", (unsigned long)traceCursor - 1, traceDevice, trafficTrace->getFileName().c_str());
+    if (record.payloadSize == 0)
+        throw cRuntimeError("Record %lu of device %u in traffic trace '%s' has no payload", (unsigned long)traceCursor - 1, traceDevice, trafficTrace->getFileName().c_str());
+    tracePayloadSize = record.payloadSize;
+    sendMeasurements = new cMessage("sendMeasurements");
+    scheduleAt(record.time, sendMeasurements);
+    return true;
+}
+
 std::pair<double,double> SimpleLoRaApp::generateUniformCircleCoordinates(double radius, double gatewayX, double gatewayY)
 {
     double randomValueRadius = uniform(0,(radius*radius));
@@ -116,16 +180,14 @@ void SimpleLoRaApp::handleMessage(cMessage *msg)
             if (simTime() >= getSimulation()->getWarmupPeriod())
                 sentPackets++;
             delete msg;
-            if(numberOfPacketsToSend == 0 || sentPackets < numberOfPacketsToSend)
+            if (trafficTrace != nullptr) {
+                if (numberOfPacketsToSend == 0 || sentPackets < numberOfPacketsToSend)
+                    scheduleNextTracePacket();
+            }
+            else if(numberOfPacketsToSend == 0 || sentPackets < numberOfPacketsToSend)
             {
-                double time;
-                int loRaSF = getSF();
-                if(loRaSF == 7) time = 7.808;
-                if(loRaSF == 8) time = 13.9776;
-                if(loRaSF == 9) time = 24.6784;
-                if(loRaSF == 10) time = 49.3568;
-                if(loRaSF == 11) time = 85.6064;
-                if(loRaSF == 12) time = 171.2128;
+                // keep the 1% duty cycle for the frame just sent
+                simtime_t time = 100 * LoRaTransmitter::computeAirtime(macHeaderLength + lastDataSize, getSF(), getBW(), getCR());
                 do {
                     timeToNextPacket = par("timeToNextPacket");
                     //if(timeToNextPacket < 3) error("Time to next packet must be grater than 3");
@@ -185,9 +247,12 @@ void SimpleLoRaApp::sendJoinRequest()
     pktRequest->setKind(DATA);
 
     auto payload = makeShared<LoRaAppPacket>();
-    payload->setChunkLength(B(par("dataSize").intValue()));
+    lastDataSize = trafficTrace != nullptr ? tracePayloadSize : par("dataSize").intValueInUnit("B");
+    if (lastDataSize <= 0)
+        throw cRuntimeError("Invalid payload size %d B", lastDataSize);
+    payload->setChunkLength(B(lastDataSize));
 
-    lastSentMeasurement = rand();
+    lastSentMeasurement = intuniform(0, RAND_MAX);
     payload->setSampleMeasurement(lastSentMeasurement);
 
     if(evaluateADRinNode && sendNextPacketWithADRACKReq)
@@ -200,6 +265,10 @@ void SimpleLoRaApp::sendJoinRequest()
     }
 
 
+    // pick the uplink channel for this transmission; RX1 follows the same channel
+    if (uplinkChannels.size() > 1)
+        setCF(uplinkChannels[intuniform(0, uplinkChannels.size() - 1)]);
+
     auto loraTag = pktRequest->addTagIfAbsent<LoRaTag>();
     loraTag->setBandwidth(getBW());
     loraTag->setCenterFrequency(getCF());
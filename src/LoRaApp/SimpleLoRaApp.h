@@ -23,6 +23,7 @@
 #include "inet/common/lifecycle/LifecycleOperation.h"
 
 #include "LoRaAppPacket_m.h"
+#include "LoRaTrafficTrace.h"
 #include "LoRa/LoRaMacControlInfo_m.h"
 #include "LoRa/LoRaRadio.h"
 
@@ -47,23 +48,34 @@ class SimpleLoRaApp : public cSimpleModule, public ILifecycle
         std::pair<double,double> generateUniformCircleCoordinates(double radius, double gatewayX, double gatewayY);
         void sendJoinRequest();
         void sendDownMgmtPacket();
+        void initializeChannelPlan();
+        bool scheduleNextTracePacket();
 
         int numberOfPacketsToSend;
         int sentPackets;
         int receivedADRCommands;
         int lastSentMeasurement;
+        int lastDataSize = 0;
+        int macHeaderLength = 0;
         simtime_t timeToFirstPacket;
         simtime_t timeToNextPacket;
 
         cMessage *configureLoRaParameters;
         cMessage *sendMeasurements;
 
+        // uplinks replayed from a traffic trace instead of timeToNextPacket
+        LoRaTrafficTrace *trafficTrace = nullptr;
+        uint32_t traceDevice = 0;
+        uint64_t traceCursor = 0;
+        int tracePayloadSize = 0;
+
         //history of sent packets;
         cOutVector sfVector;
         cOutVector tpVector;
 
         //LoRa parameters control
         LoRaRadio *loRaRadio;
+        std::vector<units::values::Hz> uplinkChannels;
 
         void setSF(int SF);
         int getSF();
@@ -87,6 +99,7 @@ class SimpleLoRaApp : public cSimpleModule, public ILifecycle
 
     public:
         SimpleLoRaApp() {}
+        virtual ~SimpleLoRaApp();
         simsignal_t LoRa_AppPacketSent;
 
 };
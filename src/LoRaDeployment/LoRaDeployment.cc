@@ -0,0 +1,485 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#include <fstream>
+#include <sstream>
+
+#include "LoRaDeployment.h"
+#include "LoRaPhy/LoRaPropagation.h"
+#include "inet/common/ModuleAccess.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
+
+namespace flora {
+
+Define_Module(LoRaDeployment);
+
+static long parseLong(const std::string& field, const char *fileName, int lineNumber)
+{
+    char *end;
+    long value = strtol(field.c_str(), &end, 10);
+    bool parsed = end != field.c_str();
+    while (isspace((unsigned char)*end))
+        end++;
+    if (!parsed || *end != '\0')
+        throw cRuntimeError("%s:%d: '%s' is not an integer", fileName, lineNumber, field.c_str());
+    return value;
+}
+
+static double parseDouble(const std::string& field, const char *fileName, int lineNumber)
+{
+    char *end;
+    double value = strtod(field.c_str(), &end);
+    bool parsed = end != field.c_str();
+    while (isspace((unsigned char)*end))
+        end++;
+    if (!parsed || *end != '\0')
+        throw cRuntimeError("%s:%d: '%s' is not a number", fileName, lineNumber, field.c_str());
+    return value;
+}
+
+void LoRaDeployment::initialize(int stage)
+{
+    cSimpleModule::initialize(stage);
+    // must run before the nodes read their mobility parameters in their own
+    // INITSTAGE_LOCAL, so this module has to precede them in the network
+    if (stage == INITSTAGE_LOCAL) {
+        nodePositions.assign(getNumNodes(), Coord::NIL);
+        gatewayPositions.assign(getNumGateways(), Coord::NIL);
+        nodeSFs.assign(getNumNodes(), -1);
+        nodeTPs.assign(getNumNodes(), NaN);
+        // gateways keep their configured positions unless overridden below
+        for (int i = 0; i < getNumGateways(); i++) {
+            cModule *mobility = getGateway(i)->getSubmodule("mobility");
+            gatewayPositions[i] = Coord(mobility->par("initialX").doubleValue(), mobility->par("initialY").doubleValue(), mobility->par("initialZ").doubleValue());
+        }
+        areaMin = Coord(par("areaMinX"), par("areaMinY"), 0);
+        areaMax = Coord(par("areaMaxX"), par("areaMaxY"), 0);
+        const char *deploymentType = par("deploymentType");
+        if (!strcmp(deploymentType, "file"))
+            readDeploymentFile(par("deploymentFile"));
+        else if (!strcmp(deploymentType, "circle"))
+            generateCircleDeployment(par("maxGatewayDistance"));
+        else if (!strcmp(deploymentType, "rectangle"))
+            generateRectangleDeployment();
+        else if (!strcmp(deploymentType, "grid"))
+            generateGridDeployment();
+        else if (!strcmp(deploymentType, "thomas"))
+            generateClusteredDeployment(par("numClusters"), par("clusterRadius"), true);
+        else if (!strcmp(deploymentType, "matern"))
+            generateClusteredDeployment(par("numClusters"), par("clusterRadius"), false);
+        else if (!strcmp(deploymentType, "hexagonal"))
+            generateHexagonalDeployment(par("cellRadius"));
+        else if (strcmp(deploymentType, ""))
+            throw cRuntimeError("Unknown deploymentType '%s'", deploymentType);
+        applyDeployment();
+    }
+    // path loss models are initialized and the applications read their
+    // initial parameters only in INITSTAGE_APPLICATION_LAYER
+    else if (stage == INITSTAGE_PHYSICAL_LAYER) {
+        const char *method = par("sfAssignment");
+        if (strcmp(method, ""))
+            assignTransmissionParameters(method);
+        int numPartitions = par("numPartitions");
+        if (numPartitions > 1) {
+            computePartitions(numPartitions);
+            const char *partitionFile = par("partitionFile");
+            if (strcmp(partitionFile, ""))
+                writePartitionFile(partitionFile);
+        }
+    }
+}
+
+void LoRaDeployment::finish()
+{
+    if (!nodePartitions.empty())
+        recordScalar("partitionLookahead", partitionLookahead);
+}
+
+Coord LoRaDeployment::getNodePosition(int index) const
+{
+    if (!nodePositions[index].isNil())
+        return nodePositions[index];
+    cModule *mobility = getNode(index)->getSubmodule("mobility");
+    return Coord(mobility->par("initialX").doubleValue(), mobility->par("initialY").doubleValue(), mobility->par("initialZ").doubleValue());
+}
+
+int LoRaDeployment::getNumNodes() const
+{
+    return getParentModule()->getSubmoduleVectorSize(par("nodeVector"));
+}
+
+int LoRaDeployment::getNumGateways() const
+{
+    return getParentModule()->getSubmoduleVectorSize(par("gatewayVector"));
+}
+
+cModule *LoRaDeployment::getNode(int index) const
+{
+    return getParentModule()->getSubmodule(par("nodeVector"), index);
+}
+
+cModule *LoRaDeployment::getGateway(int index) const
+{
+    return getParentModule()->getSubmodule(par("gatewayVector"), index);
+}
+
+void LoRaDeployment::readDeploymentFile(const char *fileName)
+{
+    std::ifstream in(fileName);
+    if (!in.is_open())
+        throw cRuntimeError("Cannot open deployment file '%s'", fileName);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ','))
+            fields.push_back(field);
+        if (fields.size() < 4)
+            throw cRuntimeError("%s:%d: expected kind,index,x,y[,sf,tp]", fileName, lineNumber);
+        int index = parseLong(fields[1], fileName, lineNumber);
+        Coord position(parseDouble(fields[2], fileName, lineNumber), parseDouble(fields[3], fileName, lineNumber), 0);
+        if (fields[0] == "node") {
+            if (index < 0 || index >= (int)nodePositions.size())
+                throw cRuntimeError("%s:%d: node index %d out of range", fileName, lineNumber, index);
+            nodePositions[index] = position;
+            if (fields.size() > 4 && !fields[4].empty())
+                nodeSFs[index] = parseLong(fields[4], fileName, lineNumber);
+            if (fields.size() > 5 && !fields[5].empty())
+                nodeTPs[index] = parseDouble(fields[5], fileName, lineNumber);
+        }
+        else if (fields[0] == "gw") {
+            if (index < 0 || index >= (int)gatewayPositions.size())
+                throw cRuntimeError("%s:%d: gateway index %d out of range", fileName, lineNumber, index);
+            gatewayPositions[index] = position;
+        }
+        else
+            throw cRuntimeError("%s:%d: unknown kind '%s'", fileName, lineNumber, fields[0].c_str());
+    }
+}
+
+void LoRaDeployment::generateCircleDeployment(double radius)
+{
+    if (gatewayPositions.empty())
+        throw cRuntimeError("Circle deployment requires a gateway");
+    // same distribution as the per-node "circle" mode of SimpleLoRaApp
+    const Coord& center = gatewayPositions[0];
+    for (auto& position : nodePositions) {
+        double r = sqrt(uniform(0, radius * radius));
+        double theta = uniform(0, 2 * M_PI);
+        position = Coord(center.x + r * cos(theta), center.y - r * sin(theta), 0);
+    }
+}
+
+Coord LoRaDeployment::clampToArea(const Coord& position) const
+{
+    return Coord(std::min(std::max(position.x, areaMin.x), areaMax.x), std::min(std::max(position.y, areaMin.y), areaMax.y), 0);
+}
+
+void LoRaDeployment::generateRectangleDeployment()
+{
+    for (auto& position : nodePositions)
+        position = Coord(uniform(areaMin.x, areaMax.x), uniform(areaMin.y, areaMax.y), 0);
+}
+
+void LoRaDeployment::generateGridDeployment()
+{
+    int numNodes = nodePositions.size();
+    if (numNodes == 0)
+        return;
+    // as square cells as the area allows
+    double sizeX = areaMax.x - areaMin.x;
+    double sizeY = areaMax.y - areaMin.y;
+    int columns = std::max(1, (int)ceil(sqrt(numNodes * sizeX / sizeY)));
+    int rows = (numNodes + columns - 1) / columns;
+    double dx = sizeX / columns;
+    double dy = sizeY / rows;
+    for (int i = 0; i < numNodes; i++)
+        nodePositions[i] = Coord(areaMin.x + (i % columns + 0.5) * dx, areaMin.y + (i / columns + 0.5) * dy, 0);
+}
+
+void LoRaDeployment::generateClusteredDeployment(int numClusters, double clusterRadius, bool gaussian)
+{
+    if (numClusters <= 0)
+        throw cRuntimeError("Clustered deployment requires a positive numClusters");
+    std::vector<Coord> parents(numClusters);
+    for (auto& parent : parents)
+        parent = Coord(uniform(areaMin.x, areaMax.x), uniform(areaMin.y, areaMax.y), 0);
+    for (auto& position : nodePositions) {
+        const Coord& parent = parents[intuniform(0, numClusters - 1)];
+        if (gaussian)
+            // Thomas process: isotropic Gaussian offset with clusterRadius as sigma
+            position = Coord(parent.x + normal(0, clusterRadius), parent.y + normal(0, clusterRadius), 0);
+        else {
+            // Matern process: uniform offset within clusterRadius
+            double r = clusterRadius * sqrt(uniform(0, 1));
+            double theta = uniform(0, 2 * M_PI);
+            position = Coord(parent.x + r * cos(theta), parent.y + r * sin(theta), 0);
+        }
+        position = clampToArea(position);
+    }
+}
+
+void LoRaDeployment::generateHexagonalDeployment(double cellRadius)
+{
+    int numGateways = gatewayPositions.size();
+    if (numGateways == 0)
+        throw cRuntimeError("Hexagonal deployment requires a gateway");
+    // pointy-top cells spiralling out from the area center, one per gateway
+    static const int directions[6][2] = {{1, 0}, {1, -1}, {0, -1}, {-1, 0}, {-1, 1}, {0, 1}};
+    Coord center = (areaMin + areaMax) / 2;
+    std::vector<std::pair<int, int>> cells = {{0, 0}};
+    for (int ring = 1; (int)cells.size() < numGateways; ring++) {
+        int q = directions[4][0] * ring;
+        int r = directions[4][1] * ring;
+        for (int side = 0; side < 6; side++) {
+            for (int step = 0; step < ring; step++) {
+                cells.push_back({q, r});
+                q += directions[side][0];
+                r += directions[side][1];
+            }
+        }
+    }
+    for (int i = 0; i < numGateways; i++) {
+        int q = cells[i].first;
+        int r = cells[i].second;
+        gatewayPositions[i] = Coord(center.x + cellRadius * sqrt(3.0) * (q + r / 2.0), center.y + cellRadius * 1.5 * r, 0);
+    }
+    // uniform over the union of equally sized cells
+    double halfWidth = cellRadius * sqrt(3.0) / 2;
+    for (auto& position : nodePositions) {
+        const Coord& cellCenter = gatewayPositions[intuniform(0, numGateways - 1)];
+        double x, y;
+        do {
+            x = uniform(-halfWidth, halfWidth);
+            y = uniform(-cellRadius, cellRadius);
+        } while (fabs(y) > cellRadius - fabs(x) / sqrt(3.0));
+        position = Coord(cellCenter.x + x, cellCenter.y + y, 0);
+    }
+}
+
+double LoRaDeployment::getSensitivity(int sf)
+{
+    // 125 kHz values of LoRaReceiver::getSensitivity()
+    switch (sf) {
+        case 7: return -124;
+        case 8: return -127;
+        case 9: return -130;
+        case 10: return -133;
+        case 11: return -135;
+        case 12: return -137;
+        default: throw cRuntimeError("Unsupported spreading factor %d", sf);
+    }
+}
+
+int LoRaDeployment::computeMinSF(double linkBudget) const
+{
+    for (int sf = 7; sf < 12; sf++)
+        if (linkBudget >= getSensitivity(sf))
+            return sf;
+    return 12;
+}
+
+double LoRaDeployment::computeMinTP(int sf, double pathLoss) const
+{
+    // the 3 dB steps used by ADR
+    double maxTP = par("maxLoRaTP");
+    for (double tp = par("minLoRaTP").doubleValue(); tp < maxTP; tp += 3)
+        if (tp - pathLoss >= getSensitivity(sf))
+            return tp;
+    return maxTP;
+}
+
+void LoRaDeployment::assignTransmissionParameters(const char *method)
+{
+    IRadioMedium *radioMedium = getModuleFromPar<IRadioMedium>(par("radioMediumModule"), this);
+    const LoRaPathLossBase *pathLoss = dynamic_cast<const LoRaPathLossBase *>(radioMedium->getPathLoss());
+    if (pathLoss == nullptr)
+        throw cRuntimeError("SF assignment requires a flora path loss model");
+    if (gatewayPositions.empty())
+        throw cRuntimeError("SF assignment requires a gateway");
+    double margin = par("assignmentMargin");
+    double maxTP = par("maxLoRaTP");
+    int numNodes = nodePositions.size();
+    // mean loss to the best gateway, including the fade margin
+    std::vector<double> pathLosses(numNodes);
+    for (int i = 0; i < numNodes; i++) {
+        Coord position = getNodePosition(i);
+        double minPathLoss = INFINITY;
+        for (const auto& gatewayPosition : gatewayPositions)
+            minPathLoss = std::min(minPathLoss, pathLoss->computeMeanPathLoss(m(position.distance(gatewayPosition))));
+        pathLosses[i] = minPathLoss + margin;
+    }
+    if (!strcmp(method, "minSF")) {
+        for (int i = 0; i < numNodes; i++)
+            nodeSFs[i] = computeMinSF(maxTP - pathLosses[i]);
+    }
+    else if (!strcmp(method, "balancedAirtime")) {
+        // the airtime doubles per SF step, so equal load needs group sizes
+        // proportional to sf / 2^sf, filled from the strongest links
+        std::vector<int> order(numNodes);
+        for (int i = 0; i < numNodes; i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&] (int a, int b) { return pathLosses[a] < pathLosses[b]; });
+        double weights[6];
+        double totalWeight = 0;
+        for (int sf = 7; sf <= 12; sf++)
+            totalWeight += weights[sf - 7] = sf / pow(2, sf);
+        int sf = 7;
+        double filled = 0;
+        for (int i : order) {
+            while (sf < 12 && filled >= numNodes * weights[sf - 7] / totalWeight) {
+                sf++;
+                filled = 0;
+            }
+            nodeSFs[i] = std::max(sf, computeMinSF(maxTP - pathLosses[i]));
+            filled++;
+        }
+    }
+    else
+        throw cRuntimeError("Unknown sfAssignment '%s'", method);
+    std::vector<int> sfCounts(6, 0);
+    for (int i = 0; i < numNodes; i++) {
+        nodeTPs[i] = computeMinTP(nodeSFs[i], pathLosses[i]);
+        cModule *app = getNode(i)->getSubmodule("app", 0);
+        app->par("initialLoRaSF").setIntValue(nodeSFs[i]);
+        app->par("initialLoRaTP").setDoubleValue(nodeTPs[i]);
+        sfCounts[nodeSFs[i] - 7]++;
+    }
+    for (int sf = 7; sf <= 12; sf++)
+        EV_INFO << "SF" << sf << ": " << sfCounts[sf - 7] << " nodes" << endl;
+}
+
+void LoRaDeployment::computePartitions(int numPartitions)
+{
+    int numNodes = nodePositions.size();
+    int numGateways = gatewayPositions.size();
+    if (numNodes < numPartitions)
+        throw cRuntimeError("Cannot split %d nodes into %d partitions", numNodes, numPartitions);
+    // nodes first, then the gateways
+    std::vector<Coord> positions(numNodes + numGateways);
+    double minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+    for (int i = 0; i < numNodes + numGateways; i++) {
+        positions[i] = i < numNodes ? getNodePosition(i) : gatewayPositions[i - numNodes];
+        minX = std::min(minX, positions[i].x);
+        maxX = std::max(maxX, positions[i].x);
+        minY = std::min(minY, positions[i].y);
+        maxY = std::max(maxY, positions[i].y);
+    }
+    // equally populated strips of nodes along the longer side, the gateways
+    // stay with the network server in the first partition
+    bool alongX = maxX - minX >= maxY - minY;
+    auto coordinate = [&] (int i) { return alongX ? positions[i].x : positions[i].y; };
+    std::vector<int> order(numNodes);
+    for (int i = 0; i < numNodes; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&] (int a, int b) { return coordinate(a) < coordinate(b); });
+    nodePartitions.assign(numNodes, 0);
+    for (int k = 0; k < numNodes; k++)
+        nodePartitions[order[k]] = (long)k * numPartitions / numNodes;
+    // any two radios of different partitions are at least as far apart as
+    // the narrowest gap along the strip axis between neighbouring radios of
+    // different partitions
+    auto partitionOf = [&] (int i) { return i < numNodes ? nodePartitions[i] : 0; };
+    order.resize(numNodes + numGateways);
+    for (int i = 0; i < numNodes + numGateways; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&] (int a, int b) { return coordinate(a) < coordinate(b); });
+    double minGap = INFINITY;
+    for (size_t k = 1; k < order.size(); k++)
+        if (partitionOf(order[k]) != partitionOf(order[k - 1]))
+            minGap = std::min(minGap, coordinate(order[k]) - coordinate(order[k - 1]));
+    IRadioMedium *radioMedium = getModuleFromPar<IRadioMedium>(par("radioMediumModule"), this);
+    const LoRaPropagation *propagation = dynamic_cast<const LoRaPropagation *>(radioMedium->getPropagation());
+    if (propagation == nullptr)
+        throw cRuntimeError("Partitioning requires the LoRaPropagation model");
+    captureDelay = propagation->getCaptureDelay();
+    partitionLookahead = minGap / propagation->getPropagationSpeed().get() + captureDelay;
+    if (partitionLookahead <= 0)
+        throw cRuntimeError("Partitions touch, the lookahead requires a positive captureDelay");
+    EV_INFO << "Split " << numNodes << " nodes into " << numPartitions << " partitions, minimum gap " << minGap << " m, lookahead " << partitionLookahead << endl;
+}
+
+void LoRaDeployment::writePartitionFile(const char *fileName) const
+{
+    std::ofstream out(fileName);
+    if (!out.is_open())
+        throw cRuntimeError("Cannot write partition file '%s'", fileName);
+    int numPartitions = par("numPartitions");
+    const char *nodeVector = par("nodeVector");
+    const char *gatewayVector = par("gatewayVector");
+    // the exact positions the lookahead was computed from
+    out.precision(17);
+    out << "# " << nodePositions.size() << " nodes in " << numPartitions << " partitions, written by " << getFullPath() << endl;
+    out << "*.hasDeployment = false" << endl;
+    out << "*.numPartitions = " << numPartitions << endl;
+    out << "*.partitionLookahead = " << partitionLookahead << "s" << endl;
+    out << "**.LoRaMedium.propagation.captureDelay = " << captureDelay << "s" << endl;
+    for (int i = 0; i < (int)gatewayPositions.size(); i++) {
+        std::string prefix = std::string("*.") + gatewayVector + "[" + std::to_string(i) + "]";
+        out << prefix << ".mobility.initialX = " << gatewayPositions[i].x << "m" << endl;
+        out << prefix << ".mobility.initialY = " << gatewayPositions[i].y << "m" << endl;
+        out << prefix << ".**.radioMediumModule = \"partition[0].LoRaMedium\"" << endl;
+    }
+    for (int i = 0; i < (int)nodePartitions.size(); i++) {
+        std::string prefix = std::string("*.") + nodeVector + "[" + std::to_string(i) + "]";
+        Coord position = getNodePosition(i);
+        out << prefix << ".mobility.initialX = " << position.x << "m" << endl;
+        out << prefix << ".mobility.initialY = " << position.y << "m" << endl;
+        if (nodeSFs[i] != -1)
+            out << prefix << ".app[0].initialLoRaSF = " << nodeSFs[i] << endl;
+        if (!std::isnan(nodeTPs[i]))
+            out << prefix << ".app[0].initialLoRaTP = " << nodeTPs[i] << "dBm" << endl;
+        out << prefix << ".**.radioMediumModule = \"partition[" << nodePartitions[i] << "].LoRaMedium\"" << endl;
+        out << prefix << ".partition-id = " << nodePartitions[i] << endl;
+        out << prefix << ".**.partition-id = " << nodePartitions[i] << endl;
+    }
+    for (int k = 0; k < numPartitions; k++) {
+        out << "*.partition[" << k << "].partition-id = " << k << endl;
+        out << "*.partition[" << k << "].**.partition-id = " << k << endl;
+    }
+    // gateways, network server, backhaul and configurator
+    out << "**.partition-id = 0" << endl;
+}
+
+void LoRaDeployment::applyDeployment()
+{
+    for (int i = 0; i < (int)nodePositions.size(); i++) {
+        cModule *node = getNode(i);
+        if (!nodePositions[i].isNil()) {
+            cModule *mobility = node->getSubmodule("mobility");
+            mobility->par("initialX").setDoubleValue(nodePositions[i].x);
+            mobility->par("initialY").setDoubleValue(nodePositions[i].y);
+        }
+        cModule *app = node->getSubmodule("app", 0);
+        if (nodeSFs[i] != -1)
+            app->par("initialLoRaSF").setIntValue(nodeSFs[i]);
+        if (!std::isnan(nodeTPs[i]))
+            app->par("initialLoRaTP").setDoubleValue(nodeTPs[i]);
+    }
+    for (int i = 0; i < (int)gatewayPositions.size(); i++) {
+        cModule *mobility = getGateway(i)->getSubmodule("mobility");
+        mobility->par("initialX").setDoubleValue(gatewayPositions[i].x);
+        mobility->par("initialY").setDoubleValue(gatewayPositions[i].y);
+    }
+    EV_INFO << "Deployed " << nodePositions.size() << " nodes and " << gatewayPositions.size() << " gateways" << endl;
+}
+
+} // namespace flora
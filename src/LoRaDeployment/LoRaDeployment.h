@@ -0,0 +1,125 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#ifndef LORADEPLOYMENT_LORADEPLOYMENT_H_
+#define LORADEPLOYMENT_LORADEPLOYMENT_H_
+
+#include <omnetpp.h>
+#include "inet/common/INETDefs.h"
+#include "inet/common/geometry/common/Coord.h"
+#include "LoRaPhy/LoRaPathLossBase.h"
+
+using namespace omnetpp;
+using namespace inet;
+
+namespace flora {
+
+/**
+ * Places all end nodes and gateways of the network in one pass, before any of
+ * them is initialized, by writing the parameters of their stationary mobility
+ * and application modules directly. This replaces thousands of per-node ini
+ * entries, which OMNeT++ has to pattern match for every parameter lookup.
+ *
+ * The deployment file is a CSV with one radio per line:
+ *
+ *   # kind,index,x,y[,sf,tp]
+ *   gw,0,544,544
+ *   node,0,756.75,475.93,10,14
+ *
+ * where kind is "node" or "gw", x and y are in meters and the optional
+ * initial spreading factor and transmission power (dBm) apply to nodes only.
+ * Radios not listed in the file keep their configured positions.
+ *
+ * Alternatively the nodes are generated from a seeded spatial distribution
+ * over the deployment area: uniformly in a disc around the first gateway
+ * ("circle"), uniformly in the rectangle ("rectangle"), on a regular grid
+ * ("grid"), clustered around uniformly placed parents with Gaussian
+ * ("thomas") or uniform disc ("matern") offsets, or uniformly over hexagonal
+ * cells, whose centers also become the gateway positions ("hexagonal").
+ *
+ * Once the path loss model is initialized, the initial spreading factor and
+ * transmission power of every node can be derived from the mean path loss
+ * to its best gateway, so that the network starts close to the state ADR
+ * would converge to: "minSF" picks the lowest feasible SF, "balancedAirtime"
+ * (EXPLoRa-SF) fills SF groups from the best links up so that every SF
+ * carries the same total airtime. Both then lower the TP as far as the link
+ * margin allows.
+ *
+ * For parallel simulation the gateways stay in the first partition, together
+ * with the network server and the backhaul, while the nodes are split into
+ * equally populated strips along the longer side of the area. The partition
+ * file is an ini fragment that runs the same deployment partitioned: the
+ * partition-id and the LoRaPartition medium of every radio, the positions
+ * and the initial SF/TP written here, and the lookahead. A transmission can
+ * reach another partition no sooner than the propagation delay across the
+ * narrowest gap between partitions plus the capture delay of LoRaPropagation,
+ * which is therefore the lookahead. Include the file into a configuration
+ * that sets parallel-simulation, e.g. see simulations/validate_parallel.sh.
+ */
+class LoRaDeployment : public cSimpleModule
+{
+  protected:
+    std::vector<Coord> nodePositions;
+    std::vector<Coord> gatewayPositions;
+    std::vector<int> nodeSFs; // -1 if unset
+    std::vector<double> nodeTPs; // dBm, NaN if unset
+
+    // geographic partitioning
+    std::vector<int> nodePartitions;
+    simtime_t captureDelay;
+    simtime_t partitionLookahead;
+
+    // deployment area of the generators
+    Coord areaMin;
+    Coord areaMax;
+
+    cModule *getNode(int index) const;
+    cModule *getGateway(int index) const;
+    int getNumNodes() const;
+    int getNumGateways() const;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *msg) override { throw cRuntimeError("This module does not handle messages"); }
+    virtual void finish() override;
+
+    virtual void readDeploymentFile(const char *fileName);
+    virtual void generateCircleDeployment(double radius);
+    virtual void generateRectangleDeployment();
+    virtual void generateGridDeployment();
+    virtual void generateClusteredDeployment(int numClusters, double clusterRadius, bool gaussian);
+    virtual void generateHexagonalDeployment(double cellRadius);
+    Coord clampToArea(const Coord& position) const;
+    virtual void applyDeployment();
+
+    virtual void assignTransmissionParameters(const char *method);
+    virtual int computeMinSF(double linkBudget) const;
+    virtual double computeMinTP(int sf, double pathLoss) const;
+    static double getSensitivity(int sf);
+
+    virtual void computePartitions(int numPartitions);
+    virtual void writePartitionFile(const char *fileName) const;
+    Coord getNodePosition(int index) const;
+
+  public:
+    const std::vector<Coord>& getNodePositions() const { return nodePositions; }
+    const std::vector<Coord>& getGatewayPositions() const { return gatewayPositions; }
+};
+
+} // namespace flora
+
+#endif /* LORADEPLOYMENT_LORADEPLOYMENT_H_ */
@@ -15,14 +15,23 @@
 
 #include "LoRaEnergyConsumer.h"
 
+#include <cmath>
+#include <map>
+
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadio.h"
 #include "LoRaPhy/LoRaTransmitter.h"
+#include "LoRaSolarEpEnergyGenerator.h"
 namespace flora {
 
 using namespace inet::power;
 
 Define_Module(LoRaEnergyConsumer);
 
+LoRaEnergyConsumer::~LoRaEnergyConsumer()
+{
+    cancelAndDelete(windowStartTimer);
+}
+
 void LoRaEnergyConsumer::initialize(int stage)
 {
     cSimpleModule::initialize(stage);
@@ -47,28 +56,80 @@ void LoRaEnergyConsumer::initialize(int stage)
         transmitterTransmittingHeaderPowerConsumption = W(0);
         transmitterTransmittingDataPowerConsumption = W(0);
 
+        // the power only depends on the radio mode and on the TP, which the
+        // app only changes between transmissions
         cModule *radioModule = getParentModule();
         radioModule->subscribe(IRadio::radioModeChangedSignal, this);
-        radioModule->subscribe(IRadio::receptionStateChangedSignal, this);
-        radioModule->subscribe(IRadio::transmissionStateChangedSignal, this);
-        radioModule->subscribe(IRadio::receivedSignalPartChangedSignal, this);
-        radioModule->subscribe(IRadio::transmittedSignalPartChangedSignal, this);
-        //radioModule->subscribe(EpEnergyStorageBase::residualEnergyCapacityChangedSignal, this);
-        //radioModule->subscribe(IdealEpEnergyStorage::residualEnergyCapacityChangedSignal, this);
         radio = check_and_cast<IRadio *>(radioModule);
+        loRaRadio = check_and_cast<LoRaRadio *>(radioModule);
 
         energySource.reference(this, "energySourceModule", true);
 
-        totalEnergyConsumed = 0;
-        energyBalance = J(0);
+        for (auto& time : timeInMode)
+            time = 0;
+        transmitTime.assign(transmitterTransmittingSupplyCurrent.size(), 0);
+        lastRadioMode = radio->getRadioMode();
+        lastModeChange = simTime();
+
+        batteryCapacity = par("batteryCapacity").doubleValueInUnit("mAh");
+        selfDischarge = par("selfDischarge");
+        temperature = par("temperature");
+        temperatureDerating = par("temperatureDerating");
+        projectionYears = par("projectionYears");
+        windowStart = getSimulation()->getWarmupPeriod();
+        if (batteryCapacity > 0 && windowStart > SIMTIME_ZERO) {
+            windowStartTimer = new cMessage("LifetimeWindowStart");
+            scheduleAt(windowStart, windowStartTimer);
+        }
     }
     else if (stage == INITSTAGE_POWER)
         energySource->addEnergyConsumer(this);
 }
 
+void LoRaEnergyConsumer::handleMessage(cMessage *message)
+{
+    if (message == windowStartTimer)
+        windowStartEnergy = getEnergyConsumed();
+    else
+        throw cRuntimeError("Unknown message");
+}
+
 void LoRaEnergyConsumer::finish()
 {
-    recordScalar("totalEnergyConsumed", double(totalEnergyConsumed));
+    recordScalar("totalEnergyConsumed", getEnergyConsumed().get());
+    if (batteryCapacity > 0)
+        recordLifetime();
+}
+
+W LoRaEnergyConsumer::getAverageHarvestedPower() const
+{
+    W power = W(0);
+    if (auto sink = dynamic_cast<IEnergySink *>(energySource.get()))
+        for (int i = 0; i < sink->getNumEnergyGenerators(); i++)
+            if (auto generator = dynamic_cast<const LoRaSolarEpEnergyGenerator *>(sink->getEnergyGenerator(i)))
+                power += generator->getAveragePowerGeneration();
+    return power;
+}
+
+void LoRaEnergyConsumer::recordLifetime()
+{
+    const double hoursPerYear = 365.25 * 24;
+    simtime_t window = simTime() - windowStart;
+    if (window <= SIMTIME_ZERO)
+        return;
+    // mean currents in mA over the steady-state window
+    double averagePower = (getEnergyConsumed() - windowStartEnergy).get() / window.dbl();
+    double averageCurrent = averagePower * 1000 / supplyVoltage;
+    double harvestedCurrent = getAverageHarvestedPower().get() * 1000 / supplyVoltage;
+    double capacity = batteryCapacity * std::max(0.0, 1 - temperatureDerating * std::max(0.0, 20 - temperature));
+    // mAh drawn from the battery per year
+    double drain = (averageCurrent - harvestedCurrent) * hoursPerYear + selfDischarge * batteryCapacity;
+    recordScalar("averageCurrent", averageCurrent, "mA");
+    recordScalar("batteryLifetime", drain > 0 ? capacity / drain : INFINITY, "year");
+    if (projectionYears > 0) {
+        recordScalar("projectedEnergyConsumed", averagePower * projectionYears * hoursPerYear * 3600, "J");
+        recordScalar("projectedResidualCapacity", std::min(capacity, std::max(0.0, capacity - drain * projectionYears)), "mAh");
+    }
 }
 
 bool LoRaEnergyConsumer::readConfigurationFile()
@@ -122,6 +183,7 @@ bool LoRaEnergyConsumer::readConfigurationFile()
     if (txSupplyCurrentList.empty())
         throw cRuntimeError("No txSupplyCurrent have been defined in txSupplyCurrents!");
 
+    std::map<int, double> supplyCurrents;
     for (cXMLElementList::const_iterator aComb = txSupplyCurrentList.begin(); aComb != txSupplyCurrentList.end(); aComb++) {
         const char *txPower, *supplyCurrent;
         if ((*aComb)->getAttribute("txPower") != nullptr)
@@ -132,94 +194,109 @@ bool LoRaEnergyConsumer::readConfigurationFile()
             supplyCurrent = (*aComb)->getAttribute("supplyCurrent");
         else
             supplyCurrent = "";
-        transmitterTransmittingSupplyCurrent[strtod(txPower, nullptr)] = strtod(supplyCurrent, nullptr);
+        double power = strtod(txPower, nullptr);
+        if (power != std::round(power))
+            throw cRuntimeError("txSupplyCurrent for txPower %s: only whole dBm values are supported", txPower);
+        supplyCurrents[(int)power] = strtod(supplyCurrent, nullptr);
     }
+    minTxPower = supplyCurrents.begin()->first;
+    transmitterTransmittingSupplyCurrent.assign(supplyCurrents.rbegin()->first - minTxPower + 1, NaN);
+    for (auto& elem : supplyCurrents)
+        transmitterTransmittingSupplyCurrent[elem.first - minTxPower] = elem.second;
     return true;
 }
 
+int LoRaEnergyConsumer::getTxPowerIndex(double txPower) const
+{
+    int index = (int)std::round(txPower) - minTxPower;
+    if (index < 0 || index >= (int)transmitterTransmittingSupplyCurrent.size() || std::isnan(transmitterTransmittingSupplyCurrent[index]))
+        throw cRuntimeError("No txSupplyCurrent configured for txPower %g dBm", txPower);
+    return index;
+}
+
 void LoRaEnergyConsumer::receiveSignal(cComponent *source, simsignal_t signal, intval_t value, cObject *details)
 {
-    if (signal == IRadio::radioModeChangedSignal ||
-        signal == IRadio::receptionStateChangedSignal ||
-        signal == IRadio::transmissionStateChangedSignal ||
-        signal == IRadio::receivedSignalPartChangedSignal ||
-        signal == IRadio::transmittedSignalPartChangedSignal)
-    {
-        powerConsumption = getPowerConsumption();
-        emit(powerConsumptionChangedSignal, powerConsumption.get());
-
-        simtime_t currentSimulationTime = simTime();
-        //if (currentSimulationTime != lastEnergyBalanceUpdate) {
-            energyBalance += s((currentSimulationTime - lastEnergyBalanceUpdate).dbl()) * (lastPowerConsumption);
-            totalEnergyConsumed = (energyBalance.get());
-            lastEnergyBalanceUpdate = currentSimulationTime;
-            lastPowerConsumption = powerConsumption;
-        //}
+    if (signal == IRadio::radioModeChangedSignal) {
+        simtime_t elapsed = simTime() - lastModeChange;
+        if (lastRadioMode == IRadio::RADIO_MODE_TRANSMITTER)
+            transmitTime[getTxPowerIndex(loRaRadio->loRaTP)] += elapsed;
+        timeInMode[lastRadioMode] += elapsed;
+        lastRadioMode = static_cast<IRadio::RadioMode>(value);
+        lastModeChange = simTime();
+        updatePowerConsumption();
     }
     else
         throw cRuntimeError("Unknown signal");
 }
 
+void LoRaEnergyConsumer::updatePowerConsumption()
+{
+    powerConsumption = getPowerConsumption();
+    emit(powerConsumptionChangedSignal, powerConsumption.get());
+}
+
+void LoRaEnergyConsumer::startAnalyticalListening()
+{
+    Enter_Method("startAnalyticalListening");
+    analyticalListeningStart = simTime();
+    updatePowerConsumption();
+}
+
+void LoRaEnergyConsumer::endAnalyticalListening()
+{
+    Enter_Method("endAnalyticalListening");
+    timeInMode[IRadio::RADIO_MODE_RECEIVER] += simTime() - analyticalListeningStart;
+    analyticalListeningStart = -1;
+    updatePowerConsumption();
+}
+
+simtime_t LoRaEnergyConsumer::getTimeInMode(IRadio::RadioMode mode) const
+{
+    simtime_t time = timeInMode[mode];
+    if (mode == lastRadioMode)
+        time += simTime() - lastModeChange;
+    if (mode == IRadio::RADIO_MODE_RECEIVER && analyticalListeningStart >= SIMTIME_ZERO)
+        time += simTime() - analyticalListeningStart;
+    return time;
+}
+
+J LoRaEnergyConsumer::getEnergyConsumed() const
+{
+    // same powers as getPowerConsumption(); SLEEP and SWITCHING draw nothing
+    W receivingPower = mW(supplyVoltage*receiverBusySupplyCurrent);
+    W idlePower = mW(supplyVoltage*idleSupplyCurrent);
+    J energy = s(getTimeInMode(IRadio::RADIO_MODE_OFF).dbl()) * offPowerConsumption;
+    energy += s(getTimeInMode(IRadio::RADIO_MODE_RECEIVER).dbl()) * receivingPower;
+    energy += s(getTimeInMode(IRadio::RADIO_MODE_TRANSCEIVER).dbl()) * idlePower;
+    int currentIndex = lastRadioMode == IRadio::RADIO_MODE_TRANSMITTER ? getTxPowerIndex(loRaRadio->loRaTP) : -1;
+    for (size_t i = 0; i < transmitTime.size(); i++) {
+        simtime_t time = transmitTime[i];
+        if ((int)i == currentIndex)
+            time += simTime() - lastModeChange;
+        if (time > 0) {
+            W transmittingPower = mW(supplyVoltage*transmitterTransmittingSupplyCurrent[i]);
+            energy += s(time.dbl()) * transmittingPower;
+        }
+    }
+    return energy;
+}
+
 W LoRaEnergyConsumer::getPowerConsumption() const
 {
     IRadio::RadioMode radioMode = radio->getRadioMode();
 
     if (radioMode == IRadio::RADIO_MODE_OFF)
         return offPowerConsumption;
+    // the radio sleeps through an analytical receive window, which draws the
+    // receiver current all the same
+    if (radioMode == IRadio::RADIO_MODE_SLEEP && analyticalListeningStart >= SIMTIME_ZERO)
+        return mW(supplyVoltage*receiverBusySupplyCurrent);
     if (radioMode == IRadio::RADIO_MODE_SLEEP || radioMode == IRadio::RADIO_MODE_SWITCHING)
         return W(0);
-
-    W powerConsumption = W(0);
-    // IRadio::ReceptionState receptionState = radio->getReceptionState();
-    // IRadio::TransmissionState transmissionState = radio->getTransmissionState();
-
-    if (radioMode == IRadio::RADIO_MODE_RECEIVER) {
-        powerConsumption += mW(supplyVoltage*receiverBusySupplyCurrent);
-    } else if (radioMode == IRadio::RADIO_MODE_TRANSMITTER) {
-        LoRaRadio *radio = check_and_cast<LoRaRadio *>(getParentModule());
-        auto current = transmitterTransmittingSupplyCurrent.find(radio->loRaTP);
-        powerConsumption += mW(supplyVoltage*current->second);
-    } else {
-        powerConsumption += mW(supplyVoltage*idleSupplyCurrent);
-    }
-
-//    if (radioMode == IRadio::RADIO_MODE_RECEIVER || radioMode == IRadio::RADIO_MODE_TRANSCEIVER) {
-//        if (receptionState == IRadio::RECEPTION_STATE_IDLE)
-//            powerConsumption += receiverIdlePowerConsumption;
-//        else if (receptionState == IRadio::RECEPTION_STATE_RECEIVING) {
-//            auto part = radio->getReceivedSignalPart();
-//            if (part == IRadioSignal::SIGNAL_PART_NONE)
-//                ;
-//            else if (radioMode == IRadio::RADIO_MODE_RECEIVER || part == IRadioSignal::SIGNAL_PART_WHOLE || part == IRadioSignal::SIGNAL_PART_PREAMBLE || part == IRadioSignal::SIGNAL_PART_HEADER || part == IRadioSignal::SIGNAL_PART_DATA )
-//                powerConsumption += receiverReceivingPowerConsumption;
-//            else
-//                throw cRuntimeError("Unknown received signal part");
-//        }
-//        else if (receptionState == IRadio::RECEPTION_STATE_BUSY || radioMode == IRadio::RADIO_MODE_RECEIVER)
-//            powerConsumption += receiverBusyPowerConsumption;
-//        else if (receptionState != IRadio::RECEPTION_STATE_UNDEFINED)
-//            throw cRuntimeError("Unknown radio reception state");
-//    }
-//
-//    if (radioMode == IRadio::RADIO_MODE_TRANSMITTER || radioMode == IRadio::RADIO_MODE_TRANSCEIVER) {
-//        if (transmissionState == IRadio::TRANSMISSION_STATE_IDLE)
-//            powerConsumption += transmitterIdlePowerConsumption;
-//        else if (transmissionState == IRadio::TRANSMISSION_STATE_TRANSMITTING) {
-//            LoRaRadio *radio = check_and_cast<LoRaRadio *>(getParentModule());
-//            auto part = radio->getTransmittedSignalPart();
-//            if (part == IRadioSignal::SIGNAL_PART_NONE)
-//                ;
-//            else if (part == IRadioSignal::SIGNAL_PART_WHOLE || part == IRadioSignal::SIGNAL_PART_PREAMBLE || part == IRadioSignal::SIGNAL_PART_HEADER || part == IRadioSignal::SIGNAL_PART_DATA)
-//            {
-//                auto current = transmitterTransmittingSupplyCurrent.find(radio->loRaTP);
-//                powerConsumption += mW(supplyVoltage*current->second);
-//            }
-//            else
-//                throw cRuntimeError("Unknown transmitted signal part");
-//        }
-//        else if (transmissionState != IRadio::TRANSMISSION_STATE_UNDEFINED)
-//            throw cRuntimeError("Unknown radio transmission state");
-//    }
-    return powerConsumption;
+    if (radioMode == IRadio::RADIO_MODE_RECEIVER)
+        return mW(supplyVoltage*receiverBusySupplyCurrent);
+    if (radioMode == IRadio::RADIO_MODE_TRANSMITTER)
+        return mW(supplyVoltage*transmitterTransmittingSupplyCurrent[getTxPowerIndex(loRaRadio->loRaTP)]);
+    return mW(supplyVoltage*idleSupplyCurrent);
 }
 }
@@ -18,28 +18,43 @@
 
 #include "inet/physicallayer/wireless/common/energyconsumer/StateBasedEpEnergyConsumer.h"
 #include "inet/power/storage/IdealEpEnergyStorage.h"
-#include <map>
+#include <vector>
+#include "LoRa/LoRaRadio.h"
 #include "inet/common/ModuleAccess.h"
 
 using namespace inet;
 
 namespace flora {
 
+/**
+ * Radio energy consumer that only counts the time spent in each radio mode
+ * (and in transmission per TP level) when the mode changes; the energy is
+ * computed from these counters when it is queried or recorded.
+ */
 class LoRaEnergyConsumer: public inet::physicallayer::StateBasedEpEnergyConsumer {
 public:
     using cIListener::finish;
     void initialize(int stage) override;
+    void handleMessage(cMessage *message) override;
     void finish() override;
     virtual W getPowerConsumption() const override;
     bool readConfigurationFile();
     virtual void receiveSignal(cComponent *source, simsignal_t signal, intval_t value, cObject *details) override;
+    /**
+     * Bracket a receive window the MAC keeps the radio asleep for; it is
+     * drawn from the energy storage as if the receiver was on.
+     */
+    void startAnalyticalListening();
+    void endAnalyticalListening();
+
+    /** Energy consumed so far, including the current radio mode. */
+    J getEnergyConsumed() const;
+    /** Time spent in a radio mode so far, analytical receive windows included. */
+    simtime_t getTimeInMode(IRadio::RadioMode mode) const;
 
 protected:
     int energyConsumerId;
-    double totalEnergyConsumed;
-    J energyBalance = J(NaN);
-    simtime_t lastEnergyBalanceUpdate = -1;
-    W lastPowerConsumption = W(0);
+    LoRaRadio *loRaRadio = nullptr;
     // All supply currents to be define in mA
     double receiverReceivingSupplyCurrent;
     double receiverBusySupplyCurrent;
@@ -47,10 +62,37 @@ protected:
     double idleSupplyCurrent;
     double sleepSupplyCurrent;
     double supplyVoltage;
-    // map between txPower (dBm) and supply current (mA)
-    std::map<double, double> transmitterTransmittingSupplyCurrent;
+    // supply current (mA) by integer txPower (dBm) from minTxPower, NaN if not configured
+    std::vector<double> transmitterTransmittingSupplyCurrent;
+    int minTxPower = 0;
+
+    // time-in-state counters, settled on every radio mode change
+    simtime_t timeInMode[IRadio::RADIO_MODE_SWITCHING + 1];
+    // time in RADIO_MODE_TRANSMITTER by txPower, indexed like the supply currents
+    std::vector<simtime_t> transmitTime;
+    IRadio::RadioMode lastRadioMode = IRadio::RADIO_MODE_OFF;
+    simtime_t lastModeChange;
+    simtime_t analyticalListeningStart = -1; // -1 outside an analytical receive window
 
+    // lifetime estimate, capacity in mAh
+    double batteryCapacity = 0;
+    double selfDischarge = NaN;
+    double temperature = NaN;
+    double temperatureDerating = NaN;
+    double projectionYears = NaN;
+    // energy consumed when the steady-state window started (end of warm-up)
+    J windowStartEnergy = J(0);
+    simtime_t windowStart;
+    cMessage *windowStartTimer = nullptr;
 
+    int getTxPowerIndex(double txPower) const;
+    void updatePowerConsumption();
+    /** Mean power of the solar generators feeding the energy storage. */
+    W getAverageHarvestedPower() const;
+    void recordLifetime();
+
+public:
+    virtual ~LoRaEnergyConsumer();
 };
 
 }
@@ -0,0 +1,81 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#include "LoRaGWEnergyModel.h"
+
+#include "inet/common/ModuleAccess.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IRadio.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/ITransmission.h"
+
+namespace flora {
+
+using namespace inet::physicallayer;
+
+Define_Module(LoRaGWEnergyModel);
+
+void LoRaGWEnergyModel::initialize(int stage)
+{
+    cSimpleModule::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        concentratorPowerConsumption = W(par("concentratorPowerConsumption"));
+        transmitterPowerConsumption = W(par("transmitterPowerConsumption"));
+        hostIdlePowerConsumption = W(par("hostIdlePowerConsumption"));
+        hostEnergyPerFrame = J(par("hostEnergyPerFrame"));
+        backhaulEnergyPerPacket = J(par("backhaulEnergyPerPacket"));
+        backhaulEnergyPerByte = J(par("backhaulEnergyPerByte"));
+        packetForwarder = getModuleFromPar<PacketForwarder>(par("packetForwarderModule"), this);
+        // downlinks are rare, so only their start is signalled
+        cModule *radioModule = getModuleFromPar<cModule>(par("radioModule"), this);
+        radioModule->subscribe(IRadio::transmissionStartedSignal, this);
+        transmitTime = 0;
+        WATCH(numDownlinks);
+    }
+}
+
+void LoRaGWEnergyModel::receiveSignal(cComponent *source, simsignal_t signal, cObject *obj, cObject *details)
+{
+    if (signal == IRadio::transmissionStartedSignal) {
+        if (simTime() >= getSimulation()->getWarmupPeriod()) {
+            numDownlinks++;
+            transmitTime += check_and_cast<const ITransmission *>(obj)->getDuration();
+        }
+    }
+    else
+        throw cRuntimeError("Unknown signal");
+}
+
+void LoRaGWEnergyModel::finish()
+{
+    simtime_t window = simTime() - getSimulation()->getWarmupPeriod();
+    if (window < SIMTIME_ZERO)
+        window = 0;
+    long frames = packetForwarder->backhaulUplinkPackets + packetForwarder->backhaulDownlinkPackets;
+    long bytes = packetForwarder->backhaulUplinkBytes + packetForwarder->backhaulDownlinkBytes;
+    J concentratorEnergy = s(window.dbl()) * concentratorPowerConsumption;
+    J transmitterEnergy = s(transmitTime.dbl()) * transmitterPowerConsumption;
+    J hostEnergy = s(window.dbl()) * hostIdlePowerConsumption + hostEnergyPerFrame * (double)frames;
+    J backhaulEnergy = backhaulEnergyPerPacket * (double)frames + backhaulEnergyPerByte * (double)bytes;
+    J totalEnergy = concentratorEnergy + transmitterEnergy + hostEnergy + backhaulEnergy;
+    recordScalar("numDownlinks", numDownlinks);
+    recordScalar("transmitTime", transmitTime);
+    recordScalar("concentratorEnergy", concentratorEnergy.get(), "J");
+    recordScalar("transmitterEnergy", transmitterEnergy.get(), "J");
+    recordScalar("hostEnergy", hostEnergy.get(), "J");
+    recordScalar("backhaulEnergy", backhaulEnergy.get(), "J");
+    recordScalar("totalEnergyConsumed", totalEnergy.get(), "J");
+}
+
+}
@@ -0,0 +1,52 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#ifndef LORAENERGYMODULES_LORAGWENERGYMODEL_H_
+#define LORAENERGYMODULES_LORAGWENERGYMODEL_H_
+
+#include "inet/common/INETDefs.h"
+#include "LoRa/PacketForwarder.h"
+
+using namespace inet;
+
+namespace flora {
+
+class LoRaGWEnergyModel : public cSimpleModule, public cListener
+{
+  public:
+    using cIListener::finish;
+  protected:
+    PacketForwarder *packetForwarder = nullptr;
+    W concentratorPowerConsumption = W(NaN);
+    W transmitterPowerConsumption = W(NaN);
+    W hostIdlePowerConsumption = W(NaN);
+    J hostEnergyPerFrame = J(NaN);
+    J backhaulEnergyPerPacket = J(NaN);
+    J backhaulEnergyPerByte = J(NaN);
+
+    long numDownlinks = 0;
+    simtime_t transmitTime;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void finish() override;
+    virtual void receiveSignal(cComponent *source, simsignal_t signal, cObject *obj, cObject *details) override;
+};
+
+}
+
+#endif /* LORAENERGYMODULES_LORAGWENERGYMODEL_H_ */
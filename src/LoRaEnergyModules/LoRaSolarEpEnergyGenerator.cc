@@ -0,0 +1,92 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#include "LoRaSolarEpEnergyGenerator.h"
+
+#include <cmath>
+
+namespace flora {
+
+Define_Module(LoRaSolarEpEnergyGenerator);
+
+LoRaSolarEpEnergyGenerator::~LoRaSolarEpEnergyGenerator()
+{
+    cancelAndDelete(timer);
+}
+
+void LoRaSolarEpEnergyGenerator::initialize(int stage)
+{
+    cSimpleModule::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        peakPowerGeneration = W(par("peakPowerGeneration"));
+        startHour = par("startHour");
+        sunrise = par("sunrise");
+        daylightHours = par("daylightHours");
+        updateInterval = par("updateInterval");
+        if (daylightHours <= 0 || daylightHours > 24)
+            throw cRuntimeError("Invalid daylightHours %g", daylightHours);
+        if (updateInterval <= 0 || updateInterval > 86400)
+            throw cRuntimeError("updateInterval must be positive and at most one day");
+        energySink.reference(this, "energySinkModule", true);
+        timer = new cMessage("UpdatePowerGeneration");
+        WATCH(powerGeneration);
+    }
+    else if (stage == INITSTAGE_POWER) {
+        energySink->addEnergyGenerator(this);
+        updatePowerGeneration();
+    }
+}
+
+void LoRaSolarEpEnergyGenerator::handleMessage(cMessage *message)
+{
+    if (message == timer)
+        updatePowerGeneration();
+    else
+        throw cRuntimeError("Unknown message");
+}
+
+W LoRaSolarEpEnergyGenerator::computeMeanPowerGeneration(simtime_t t1, simtime_t t2) const
+{
+    // integral of the daylight half sine, with the phase measured in hours
+    // since the sunrise of the day t1 falls in
+    double begin = std::fmod(startHour + t1.dbl() / 3600 - sunrise, 24);
+    if (begin < 0)
+        begin += 24;
+    double end = begin + (t2 - t1).dbl() / 3600;
+    double energy = 0;    // peak power x hours
+    for (double day = 0; day < end; day += 24) {
+        double from = std::max(begin - day, 0.0);
+        double to = std::min(end - day, daylightHours);
+        if (from < to)
+            energy += daylightHours / M_PI * (std::cos(M_PI * from / daylightHours) - std::cos(M_PI * to / daylightHours));
+    }
+    return peakPowerGeneration * (energy / (end - begin));
+}
+
+void LoRaSolarEpEnergyGenerator::updatePowerGeneration()
+{
+    simtime_t next = simTime() + updateInterval;
+    powerGeneration = computeMeanPowerGeneration(simTime(), next);
+    emit(powerGenerationChangedSignal, powerGeneration.get());
+    scheduleAt(next, timer);
+}
+
+W LoRaSolarEpEnergyGenerator::getAveragePowerGeneration() const
+{
+    return peakPowerGeneration * (2 * daylightHours / (M_PI * 24));
+}
+
+}
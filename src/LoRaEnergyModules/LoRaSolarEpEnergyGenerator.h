@@ -0,0 +1,62 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#ifndef LORAENERGYMODULES_LORASOLAREPENERGYGENERATOR_H_
+#define LORAENERGYMODULES_LORASOLAREPENERGYGENERATOR_H_
+
+#include "inet/common/ModuleRefByPar.h"
+#include "inet/power/contract/IEpEnergyGenerator.h"
+#include "inet/power/contract/IEpEnergySink.h"
+
+using namespace inet;
+using namespace inet::power;
+
+namespace flora {
+
+class LoRaSolarEpEnergyGenerator : public cSimpleModule, public virtual IEpEnergyGenerator
+{
+  protected:
+    ModuleRefByPar<IEpEnergySink> energySink;
+    W peakPowerGeneration = W(NaN);
+    double startHour = NaN;
+    double sunrise = NaN;
+    double daylightHours = NaN;
+    simtime_t updateInterval;
+    cMessage *timer = nullptr;
+
+    W powerGeneration = W(0);
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *message) override;
+
+    /** Mean power between t1 and t2, at most one day apart. */
+    virtual W computeMeanPowerGeneration(simtime_t t1, simtime_t t2) const;
+    virtual void updatePowerGeneration();
+
+  public:
+    virtual ~LoRaSolarEpEnergyGenerator();
+
+    virtual IEnergySink *getEnergySink() const override { return energySink.get(); }
+    virtual W getPowerGeneration() const override { return powerGeneration; }
+    /** Mean power over a whole day. */
+    virtual W getAveragePowerGeneration() const;
+};
+
+}
+
+#endif /* LORAENERGYMODULES_LORASOLAREPENERGYGENERATOR_H_ */
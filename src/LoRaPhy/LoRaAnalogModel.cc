@@ -13,6 +13,9 @@
 // along with this program.  If not, see http://www.gnu.org/licenses/.
 // 
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "LoRaPhy/LoRaAnalogModel.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarAnalogModel.h"
@@ -21,12 +24,157 @@
 #include "LoRaReception.h"
 #include "LoRaTransmission.h"
 #include "LoRaReceiver.h"
+#include "LoRaPathLossBase.h"
+#include "LoRaMedium.h"
+#include "LoRa/LoRaGWRadio.h"
 #include "LoRa/LoRaRadio.h"
 
 namespace flora {
 
 Define_Module(LoRaAnalogModel);
 
+void LoRaAnalogModel::initialize(int stage)
+{
+    ScalarAnalogModelBase::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        linkBudgetPrecomputed = false;
+        WATCH(linkBudgetPrecomputed);
+    }
+    // radios register on the medium in the physical layer stage and their
+    // positions are final by now
+    else if (stage == INITSTAGE_LAST) {
+        if (par("precomputeLinkBudget"))
+            precomputeLinkBudget();
+    }
+}
+
+double LoRaAnalogModel::computeStaticLinkLoss(const IRadio *transmitter, const IRadio *receiver, const LoRaPathLossBase *pathLoss) const
+{
+    const IMobility *transmitterMobility = transmitter->getAntenna()->getMobility();
+    const IMobility *receiverMobility = receiver->getAntenna()->getMobility();
+    Coord transmitterPosition = transmitterMobility->getCurrentPosition();
+    Coord receiverPosition = receiverMobility->getCurrentPosition();
+    double transmitterAntennaGain = computeAntennaGain(transmitter->getAntenna()->getGain().get(), transmitterPosition, receiverPosition, transmitterMobility->getCurrentAngularPosition());
+    double receiverAntennaGain = computeAntennaGain(receiver->getAntenna()->getGain().get(), receiverPosition, transmitterPosition, receiverMobility->getCurrentAngularPosition());
+    m distance = m(transmitterPosition.distance(receiverPosition));
+    return pathLoss->computeMeanPathLoss(distance) - math::fraction2dB(transmitterAntennaGain * receiverAntennaGain);
+}
+
+void LoRaAnalogModel::precomputeLinkBudget()
+{
+    const LoRaMedium *medium = check_and_cast<const LoRaMedium *>(getParentModule());
+    const LoRaPathLossBase *pathLoss = dynamic_cast<const LoRaPathLossBase *>(medium->getPathLoss());
+    if (pathLoss == nullptr) {
+        EV_WARN << "Link budget precomputation requires a flora path loss model, disabled" << endl;
+        return;
+    }
+    const std::vector<const IRadio *>& radios = medium->getRadiosById();
+    for (auto radio : radios) {
+        // mobility models without a speed bound report NaN, they may move
+        if (radio != nullptr && !medium->isProxyRadio(radio) && !(radio->getAntenna()->getMobility()->getMaxSpeed() == 0)) {
+            EV_WARN << "Link budget precomputation requires stationary radios, disabled" << endl;
+            return;
+        }
+    }
+
+    std::vector<const IRadio *> nodes;
+    std::vector<const IRadio *> gateways;
+    linkSlots.assign(radios.size(), -1);
+    gatewayRadios.assign(radios.size(), false);
+    for (auto radio : radios) {
+        // the proxy radio transmits from the positions of remote radios
+        if (radio == nullptr || medium->isProxyRadio(radio))
+            continue;
+        if (dynamic_cast<const LoRaGWRadio *>(radio) != nullptr) {
+            linkSlots[radio->getId()] = gateways.size();
+            gatewayRadios[radio->getId()] = true;
+            gateways.push_back(radio);
+        }
+        else {
+            linkSlots[radio->getId()] = nodes.size();
+            nodes.push_back(radio);
+        }
+    }
+    numLinkNodes = nodes.size();
+
+    // every node-gateway pair, one contiguous row per gateway
+    gatewayLinkLoss.resize(gateways.size() * nodes.size());
+    for (size_t g = 0; g < gateways.size(); g++)
+        for (size_t n = 0; n < nodes.size(); n++)
+            gatewayLinkLoss[g * nodes.size() + n] = computeStaticLinkLoss(nodes[n], gateways[g], pathLoss);
+
+    // node-node pairs only within the interference range, in CSR layout
+    m maxRange = medium->getMediumLimitCache()->getMaxInterferenceRange();
+    nodeLinkOffsets.assign(1, 0);
+    nodeLinkPeers.clear();
+    nodeLinkLoss.clear();
+    if (std::isfinite(maxRange.get()) && maxRange > m(0)) {
+        // bucket the nodes into a grid of maxRange cells, so that the peers
+        // of a node are all in the 3x3 cells around its own
+        double cellSize = maxRange.get();
+        std::vector<Coord> positions(nodes.size());
+        std::unordered_map<uint64_t, std::vector<int>> cells;
+        auto cellKey = [] (int64_t x, int64_t y) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y; };
+        for (size_t i = 0; i < nodes.size(); i++) {
+            positions[i] = nodes[i]->getAntenna()->getMobility()->getCurrentPosition();
+            cells[cellKey((int64_t)floor(positions[i].x / cellSize), (int64_t)floor(positions[i].y / cellSize))].push_back(i);
+        }
+        std::vector<int> peers;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            int64_t cx = (int64_t)floor(positions[i].x / cellSize);
+            int64_t cy = (int64_t)floor(positions[i].y / cellSize);
+            peers.clear();
+            for (int64_t x = cx - 1; x <= cx + 1; x++) {
+                for (int64_t y = cy - 1; y <= cy + 1; y++) {
+                    auto cell = cells.find(cellKey(x, y));
+                    if (cell == cells.end())
+                        continue;
+                    for (int j : cell->second)
+                        if (j != (int)i && m(positions[i].distance(positions[j])) <= maxRange)
+                            peers.push_back(j);
+                }
+            }
+            // findStaticLinkLoss binary searches the peers
+            std::sort(peers.begin(), peers.end());
+            for (int j : peers) {
+                nodeLinkPeers.push_back(j);
+                nodeLinkLoss.push_back(computeStaticLinkLoss(nodes[j], nodes[i], pathLoss));
+            }
+            nodeLinkOffsets.push_back(nodeLinkPeers.size());
+        }
+    }
+    linkBudgetPrecomputed = true;
+    EV_INFO << "Precomputed link budget for " << nodes.size() << " nodes, " << gateways.size() << " gateways and " << nodeLinkPeers.size() << " node-node links" << endl;
+}
+
+bool LoRaAnalogModel::findStaticLinkLoss(int transmitterId, int receiverId, double& loss) const
+{
+    if (transmitterId >= (int)linkSlots.size() || receiverId >= (int)linkSlots.size())
+        return false;
+    int transmitterSlot = linkSlots[transmitterId];
+    int receiverSlot = linkSlots[receiverId];
+    if (transmitterSlot == -1 || receiverSlot == -1)
+        return false;
+    bool transmitterIsGateway = gatewayRadios[transmitterId];
+    bool receiverIsGateway = gatewayRadios[receiverId];
+    if (transmitterIsGateway != receiverIsGateway) {
+        int gatewaySlot = transmitterIsGateway ? transmitterSlot : receiverSlot;
+        int nodeSlot = transmitterIsGateway ? receiverSlot : transmitterSlot;
+        loss = gatewayLinkLoss[gatewaySlot * numLinkNodes + nodeSlot];
+        return true;
+    }
+    if (!transmitterIsGateway && nodeLinkOffsets.size() > 1) {
+        auto begin = nodeLinkPeers.begin() + nodeLinkOffsets[receiverSlot];
+        auto end = nodeLinkPeers.begin() + nodeLinkOffsets[receiverSlot + 1];
+        auto it = std::lower_bound(begin, end, transmitterSlot);
+        if (it != end && *it == transmitterSlot) {
+            loss = nodeLinkLoss[it - nodeLinkPeers.begin()];
+            return true;
+        }
+    }
+    return false;
+}
+
 std::ostream& LoRaAnalogModel::printToStream(std::ostream& stream, int level, int evFlags) const
 {
     return stream << "LoRaAnalogModel";
@@ -84,6 +232,14 @@ const W LoRaAnalogModel::getBackgroundNoisePower(const LoRaBandListening *listen
 }
 
 W LoRaAnalogModel::computeReceptionPower(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival) const
+{
+    const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
+    if (auto cached = loRaTransmission->getCachedReceptionPower(receiverRadio->getId()))
+        return cached->power;
+    return loRaTransmission->setCachedReceptionPower(receiverRadio->getId(), computeLinkReceptionPower(receiverRadio, transmission, arrival)).power;
+}
+
+W LoRaAnalogModel::computeLinkReceptionPower(const IRadio *receiverRadio, const ITransmission *transmission, const IArrival *arrival) const
 {
     const IRadioMedium *radioMedium = receiverRadio->getMedium();
 //    const IRadio *transmitterRadio = transmission->getTransmitter();
@@ -96,11 +252,18 @@ W LoRaAnalogModel::computeReceptionPower(const IRadio *receiverRadio, const ITra
 //    const Quaternion transmissionDirection = computeTransmissionDirection(transmission, arrival);
 //    const Quaternion transmissionAntennaDirection = transmission->getStartOrientation() - transmissionDirection;
 //    const Quaternion receptionAntennaDirection = transmissionDirection - arrival->getStartOrientation();
-    double transmitterAntennaGain = computeAntennaGain(transmission->getTransmitterAntennaGain(), transmission->getStartPosition(), arrival->getStartPosition(), transmission->getStartOrientation());
-    double receiverAntennaGain = computeAntennaGain(receiverRadio->getAntenna()->getGain().get(), arrival->getStartPosition(), transmission->getStartPosition(), arrival->getStartOrientation());
-    double pathLoss = radioMedium->getPathLoss()->computePathLoss(transmission, arrival);
+    const LoRaPathLossBase *loRaPathLoss = dynamic_cast<const LoRaPathLossBase *>(radioMedium->getPathLoss());
     double obstacleLoss = radioMedium->getObstacleLoss() ? radioMedium->getObstacleLoss()->computeObstacleLoss(narrowbandSignalAnalogModel->getCenterFrequency(), transmission->getStartPosition(), receptionStartPosition) : 1;
     W transmissionPower = scalarSignalAnalogModel->getPower();
+    double staticLinkLoss;
+    if (linkBudgetPrecomputed && findStaticLinkLoss(transmission->getTransmitterId(), receiverRadio->getId(), staticLinkLoss)) {
+        // static topology: only the random part is evaluated per reception
+        double linkGain = math::dB2fraction(-(staticLinkLoss + loRaPathLoss->computeShadowing(transmission, receiverRadio, arrival)));
+        return transmissionPower * std::min(1.0, linkGain * obstacleLoss);
+    }
+    double transmitterAntennaGain = computeAntennaGain(transmission->getTransmitterAntennaGain(), transmission->getStartPosition(), arrival->getStartPosition(), transmission->getStartOrientation());
+    double receiverAntennaGain = computeAntennaGain(receiverRadio->getAntenna()->getGain().get(), arrival->getStartPosition(), transmission->getStartPosition(), arrival->getStartOrientation());
+    double pathLoss = loRaPathLoss != nullptr ? loRaPathLoss->computePathLoss(transmission, receiverRadio, arrival) : radioMedium->getPathLoss()->computePathLoss(transmission, arrival);
     return transmissionPower * std::min(1.0, transmitterAntennaGain * receiverAntennaGain * pathLoss * obstacleLoss);
 }
 
@@ -113,12 +276,13 @@ const IReception *LoRaAnalogModel::computeReception(const IRadio *receiverRadio,
     const Quaternion receptionEndOrientation = arrival->getEndOrientation();
     const Coord receptionStartPosition = arrival->getStartPosition();
     const Coord receptionEndPosition = arrival->getEndPosition();
-    W receivedPower = computeReceptionPower(receiverRadio, transmission, arrival);
+    computeReceptionPower(receiverRadio, transmission, arrival);
+    const LoRaTransmission::ReceptionPower *receivedPower = loRaTransmission->getCachedReceptionPower(receiverRadio->getId());
     Hz LoRaCF = loRaTransmission->getLoRaCF();
     int LoRaSF = loRaTransmission->getLoRaSF();
     Hz LoRaBW = loRaTransmission->getLoRaBW();
     int LoRaCR = loRaTransmission->getLoRaCR();
-    return new LoRaReception(receiverRadio, transmission, receptionStartTime, receptionEndTime, receptionStartPosition, receptionEndPosition, receptionStartOrientation, receptionEndOrientation, LoRaCF, LoRaBW, receivedPower, LoRaSF, LoRaCR);
+    return new LoRaReception(receiverRadio, transmission, receptionStartTime, receptionEndTime, receptionStartPosition, receptionEndPosition, receptionStartOrientation, receptionEndOrientation, LoRaCF, LoRaBW, receivedPower->power, receivedPower->powerDbm, LoRaSF, LoRaCR);
 }
 
 const INoise *LoRaAnalogModel::computeNoise(const IListening *listening, const IInterference *interference) const
@@ -21,11 +21,31 @@
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarNoise.h"
 
 #include "LoRaBandListening.h"
+#include "LoRaPathLossBase.h"
 
 namespace flora {
 
 class LoRaAnalogModel : public ScalarAnalogModelBase
 {
+  protected:
+    // static link budget: mean path loss including antenna gains in dB
+    bool linkBudgetPrecomputed = false;
+    std::vector<int> linkSlots; // radio id -> node or gateway index
+    std::vector<bool> gatewayRadios; // radio id -> is gateway
+    int numLinkNodes = 0;
+    std::vector<double> gatewayLinkLoss; // [gateway * numLinkNodes + node]
+    std::vector<int> nodeLinkOffsets; // per receiving node into nodeLinkPeers
+    std::vector<int> nodeLinkPeers; // sorted transmitting node indices
+    std::vector<double> nodeLinkLoss;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual W computeLinkReceptionPower(const IRadio *radio, const ITransmission *transmission, const IArrival *arrival) const;
+    virtual void precomputeLinkBudget();
+    virtual double computeStaticLinkLoss(const IRadio *transmitter, const IRadio *receiver, const LoRaPathLossBase *pathLoss) const;
+    bool findStaticLinkLoss(int transmitterId, int receiverId, double& loss) const;
+
   public:
     const W getBackgroundNoisePower(const LoRaBandListening *listening) const;
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
@@ -0,0 +1,87 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef LORAPHY_LORACOUNTERRNG_H_
+#define LORAPHY_LORACOUNTERRNG_H_
+
+#include <cmath>
+#include <cstdint>
+
+namespace flora {
+
+/**
+ * Counter based random numbers (Philox4x32-10, Salmon et al., SC'11). Every
+ * draw is a pure function of the seed and a 128 bit counter, e.g. a
+ * (transmission id, receiver id) pair, so the values do not depend on the
+ * order, or the thread, in which they are evaluated.
+ */
+class LoRaCounterRng
+{
+  protected:
+    uint32_t key[2];
+
+    static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+    {
+        uint64_t product = (uint64_t)a * b;
+        hi = product >> 32;
+        lo = (uint32_t)product;
+    }
+
+    void philox(const uint32_t counter[4], uint32_t out[4]) const
+    {
+        uint32_t x[4] = {counter[0], counter[1], counter[2], counter[3]};
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < 10; round++) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(0xD2511F53, x[0], hi0, lo0);
+            mulhilo(0xCD9E8D57, x[2], hi1, lo1);
+            uint32_t y[4] = {hi1 ^ x[1] ^ k0, lo1, hi0 ^ x[3] ^ k1, lo0};
+            x[0] = y[0]; x[1] = y[1]; x[2] = y[2]; x[3] = y[3];
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        out[0] = x[0]; out[1] = x[1]; out[2] = x[2]; out[3] = x[3];
+    }
+
+  public:
+    explicit LoRaCounterRng(uint64_t seed)
+    {
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+    }
+
+    /** Returns two uniform values in (0, 1) for the counter (a, b). */
+    void uniform2(uint64_t a, uint64_t b, double& u1, double& u2) const
+    {
+        uint32_t counter[4] = {(uint32_t)a, (uint32_t)(a >> 32), (uint32_t)b, (uint32_t)(b >> 32)};
+        uint32_t out[4];
+        philox(counter, out);
+        // 53 bit mantissas, never exactly 0 or 1
+        u1 = ((((uint64_t)out[0] << 21) ^ (out[1] >> 11)) + 0.5) / 9007199254740992.0;
+        u2 = ((((uint64_t)out[2] << 21) ^ (out[3] >> 11)) + 0.5) / 9007199254740992.0;
+    }
+
+    /** Returns a normally distributed value for the counter (a, b). */
+    double normal(uint64_t a, uint64_t b, double mean, double stddev) const
+    {
+        double u1, u2;
+        uniform2(a, b, u1, u2);
+        return mean + stddev * std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORACOUNTERRNG_H_ */
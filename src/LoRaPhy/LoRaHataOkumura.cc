@@ -25,7 +25,7 @@ LoRaHataOkumura::LoRaHataOkumura()
 
 void LoRaHataOkumura::initialize(int stage)
 {
-    FreeSpacePathLoss::initialize(stage);
+    LoRaPathLossBase::initialize(stage);
     if (stage == INITSTAGE_LOCAL) {
         K1 = par("K1");
         K2 = par("K2");
@@ -38,11 +38,15 @@ std::ostream& LoRaHataOkumura::printToStream(std::ostream& stream, int level, in
     return stream;
 }
 
-double LoRaHataOkumura::computePathLoss(mps propagationSpeed, Hz frequency, m distance) const
+double LoRaHataOkumura::computeMeanPathLoss(m distance) const
 {
     // build based on documentation from Actility
-    double PL_db = K1 + K2 * log10(distance.get()/1000);
-    return math::dB2fraction(-PL_db);
+    return K1 + K2 * log10(distance.get()/1000);
+}
+
+m LoRaHataOkumura::computeDistance(double meanPathLoss) const
+{
+    return m(1000 * pow(10, (meanPathLoss - K1) / K2));
 }
 
 }
@@ -16,7 +16,7 @@
 #ifndef LORAPHY_LORAHATAOKUMURA_H_
 #define LORAPHY_LORAHATAOKUMURA_H_
 
-#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPathLossBase.h"
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -25,7 +25,7 @@ namespace flora {
 /**
  * This class implements the LoRaHataOkumura.
  */
-class LoRaHataOkumura : public FreeSpacePathLoss
+class LoRaHataOkumura : public LoRaPathLossBase
 {
   protected:
     double K1;
@@ -37,7 +37,8 @@ class LoRaHataOkumura : public FreeSpacePathLoss
   public:
     LoRaHataOkumura();
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
-    virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
+    virtual double computeMeanPathLoss(m distance) const override;
+    virtual m computeDistance(double meanPathLoss) const override;
 };
 
 } // namespace inet
@@ -15,6 +15,8 @@
 
 #include "LoRaLogNormalShadowing.h"
 #include "inet/common/INETMath.h"
+#include "LoRaMedium.h"
+#include "LoRa/LoRaGWRadio.h"
 
 namespace flora {
 
@@ -26,11 +28,22 @@ LoRaLogNormalShadowing::LoRaLogNormalShadowing()
 
 void LoRaLogNormalShadowing::initialize(int stage)
 {
-    FreeSpacePathLoss::initialize(stage);
+    LoRaPathLossBase::initialize(stage);
     if (stage == INITSTAGE_LOCAL) {
         sigma = par("sigma");
         gamma = par("gamma");
         d0 = m(par("d0"));
+        const char *shadowing = par("shadowing");
+        if (!strcmp(shadowing, "perPacket"))
+            shadowingMode = SHADOWING_PER_PACKET;
+        else if (!strcmp(shadowing, "frozenLink"))
+            shadowingMode = SHADOWING_FROZEN_LINK;
+        else if (!strcmp(shadowing, "correlatedField"))
+            shadowingMode = SHADOWING_CORRELATED_FIELD;
+        else
+            throw cRuntimeError("Unknown shadowing mode '%s'", shadowing);
+        decorrelationDistance = m(par("decorrelationDistance"));
+        fieldResolution = m(par("fieldResolution"));
     }
 }
 
@@ -44,24 +57,130 @@ std::ostream& LoRaLogNormalShadowing::printToStream(std::ostream& stream, int le
     return stream;
 }
 
-double LoRaLogNormalShadowing::computePathLoss(mps propagationSpeed, Hz frequency, m distance) const
+double LoRaLogNormalShadowing::computeMeanPathLoss(m distance) const
 {
     // parameters taken from paper "Do LoRa Low-Power Wide-Area Networks Scale?"
     double PL_d0_db = 127.41;
-    double PL_db = PL_d0_db + 10 * gamma * log10(unit(distance / d0).get()) + normal(0.0, sigma);
-    return math::dB2fraction(-PL_db);
+    return PL_d0_db + 10 * gamma * log10(unit(distance / d0).get());
 }
 
-m LoRaLogNormalShadowing::computeRange(W transmissionPower) const
+double LoRaLogNormalShadowing::computeShadowing(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const
+{
+    if (shadowingMode == SHADOWING_PER_PACKET)
+        return drawShadowing(transmission->getId(), receiver->getId());
+    else if (shadowingMode == SHADOWING_FROZEN_LINK) {
+        const LoRaMedium *medium = check_and_cast<const LoRaMedium *>(receiver->getMedium());
+        const IRadio *transmitter = medium->getRadioById(transmission->getTransmitterId());
+        // the link would be drawn for the proxy radio, not the remote transmitter
+        if (transmitter != nullptr && medium->isProxyRadio(transmitter))
+            throw cRuntimeError("Frozen shadowing is not supported with partitions");
+        return computeFrozenLinkShadowing(transmitter, receiver);
+    }
+    else
+        return computeFieldShadowing(transmission->getStartPosition(), arrival->getStartPosition());
+}
+
+int LoRaLogNormalShadowing::getRadioSlot(const IRadio *radio) const
+{
+    int radioId = radio->getId();
+    if (radioId >= (int)radioSlots.size()) {
+        radioSlots.resize(radioId + 1, -1);
+        gatewaySlots.resize(radioId + 1, false);
+    }
+    if (radioSlots[radioId] == -1) {
+        if (dynamic_cast<const LoRaGWRadio *>(radio) != nullptr) {
+            radioSlots[radioId] = gatewayLinkShadowing.size();
+            gatewaySlots[radioId] = true;
+            gatewayLinkShadowing.push_back(std::vector<double>(numNodeSlots, NaN));
+        }
+        else
+            radioSlots[radioId] = numNodeSlots++;
+    }
+    return radioSlots[radioId];
+}
+
+double LoRaLogNormalShadowing::computeFrozenLinkShadowing(const IRadio *transmitter, const IRadio *receiver) const
+{
+    if (transmitter == nullptr)
+        throw cRuntimeError("Frozen shadowing requires the transmitter radio to be registered on the medium");
+    int transmitterSlot = getRadioSlot(transmitter);
+    int receiverSlot = getRadioSlot(receiver);
+    bool transmitterIsGateway = gatewaySlots[transmitter->getId()];
+    bool receiverIsGateway = gatewaySlots[receiver->getId()];
+    uint64_t low = std::min(transmitter->getId(), receiver->getId());
+    uint64_t high = std::max(transmitter->getId(), receiver->getId());
+    // link draws use counters that transmission ids never reach
+    uint64_t linkCounter = (high << 32) | low;
+    // links are reciprocal, so both directions share one value
+    if (transmitterIsGateway != receiverIsGateway) {
+        int gatewaySlot = transmitterIsGateway ? transmitterSlot : receiverSlot;
+        int nodeSlot = transmitterIsGateway ? receiverSlot : transmitterSlot;
+        std::vector<double>& row = gatewayLinkShadowing[gatewaySlot];
+        if (nodeSlot >= (int)row.size())
+            row.resize(numNodeSlots, NaN);
+        if (std::isnan(row[nodeSlot]))
+            row[nodeSlot] = drawShadowing(linkCounter, UINT64_MAX);
+        return row[nodeSlot];
+    }
+    auto it = otherLinkShadowing.find(linkCounter);
+    if (it == otherLinkShadowing.end())
+        it = otherLinkShadowing.emplace(linkCounter, drawShadowing(linkCounter, UINT64_MAX)).first;
+    return it->second;
+}
+
+double LoRaLogNormalShadowing::computeFieldShadowing(const Coord& transmitterPosition, const Coord& receiverPosition) const
+{
+    if (shadowingField.empty())
+        generateShadowingField();
+    // the two unit-variance site values are correlated by a^(|dx| + |dy|)
+    // in grid cells, so their sum has variance 2 + 2 rho; normalizing by it
+    // keeps the link marginal at N(0, sigma) at any distance
+    int tx, ty, rx, ry;
+    getFieldCell(transmitterPosition, tx, ty);
+    getFieldCell(receiverPosition, rx, ry);
+    double a = exp(-fieldResolution.get() / decorrelationDistance.get());
+    double rho = pow(a, std::abs(tx - rx) + std::abs(ty - ry));
+    double sum = shadowingField[ty * fieldSizeX + tx] + shadowingField[ry * fieldSizeX + rx];
+    return sigma * sum / sqrt(2 + 2 * rho);
+}
+
+void LoRaLogNormalShadowing::generateShadowingField() const
+{
+    const IMediumLimitCache *mediumLimitCache = check_and_cast<const IRadioMedium *>(getParentModule())->getMediumLimitCache();
+    Coord min = mediumLimitCache->getMinConstraintArea();
+    Coord max = mediumLimitCache->getMaxConstraintArea();
+    if (std::isnan(min.x) || std::isnan(max.x) || std::isinf(min.x) || std::isinf(max.x) || std::isnan(min.y) || std::isnan(max.y) || std::isinf(min.y) || std::isinf(max.y))
+        throw cRuntimeError("The correlated shadowing field requires a finite constraint area");
+    double resolution = fieldResolution.get();
+    fieldOrigin = min;
+    fieldSizeX = (int)ceil((max.x - min.x) / resolution) + 1;
+    fieldSizeY = (int)ceil((max.y - min.y) / resolution) + 1;
+    shadowingField.resize((size_t)fieldSizeX * fieldSizeY);
+    for (auto& value : shadowingField)
+        value = normal(0.0, 1.0);
+    // separable first order autoregressive filtering gives the exponential
+    // (Gudmundson) autocorrelation exp(-d / decorrelationDistance) per axis
+    double a = exp(-resolution / decorrelationDistance.get());
+    double b = sqrt(1 - a * a);
+    for (int y = 0; y < fieldSizeY; y++)
+        for (int x = 1; x < fieldSizeX; x++)
+            shadowingField[y * fieldSizeX + x] = a * shadowingField[y * fieldSizeX + x - 1] + b * shadowingField[y * fieldSizeX + x];
+    for (int y = 1; y < fieldSizeY; y++)
+        for (int x = 0; x < fieldSizeX; x++)
+            shadowingField[y * fieldSizeX + x] = a * shadowingField[(y - 1) * fieldSizeX + x] + b * shadowingField[y * fieldSizeX + x];
+    EV_INFO << "Generated " << fieldSizeX << "x" << fieldSizeY << " correlated shadowing field" << endl;
+}
+
+void LoRaLogNormalShadowing::getFieldCell(const Coord& position, int& x, int& y) const
+{
+    x = std::max(0, std::min(fieldSizeX - 1, (int)round((position.x - fieldOrigin.x) / fieldResolution.get())));
+    y = std::max(0, std::min(fieldSizeY - 1, (int)round((position.y - fieldOrigin.y) / fieldResolution.get())));
+}
+
+m LoRaLogNormalShadowing::computeDistance(double meanPathLoss) const
 {
-    // parameters taken from paper "Do LoRa Low-Power Wide-Area Networks Scale?"
     double PL_d0_db = 127.41;
-    double max_sensitivity = -137;
-    double trans_power_db = round(10 * log10(transmissionPower.get()*1000));
-    EV << "LoRaLogNormalShadowing transmissionPower in W = " << transmissionPower << " in dBm = " << trans_power_db << endl;
-    double rhs = (trans_power_db - PL_d0_db - max_sensitivity)/(10 * gamma);
-    double distance = d0.get() * pow(10, rhs);
-    return m(distance);
+    return d0 * pow(10, (meanPathLoss - PL_d0_db) / (10 * gamma));
 }
 
 }
@@ -16,7 +16,8 @@
 #ifndef LORAPHY_LORALOGNORMALSHADOWING_H_
 #define LORAPHY_LORALOGNORMALSHADOWING_H_
 
-#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPathLossBase.h"
+#include <unordered_map>
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -25,23 +26,52 @@ namespace flora {
 /**
  * This class implements the log normal shadowing model.
  */
-class LoRaLogNormalShadowing : public FreeSpacePathLoss
+class LoRaLogNormalShadowing : public LoRaPathLossBase
 {
+  public:
+    enum ShadowingMode {
+        SHADOWING_PER_PACKET,
+        SHADOWING_FROZEN_LINK,
+        SHADOWING_CORRELATED_FIELD
+    };
+
   protected:
     m d0;
     double gamma;
-    double sigma;
+    ShadowingMode shadowingMode;
+
+    // frozen per-link shadowing in dB: one flat row over node slots per
+    // gateway, other links (node-node, gateway-gateway) are kept sparse
+    mutable std::vector<int> radioSlots;
+    mutable std::vector<bool> gatewaySlots;
+    mutable int numNodeSlots = 0;
+    mutable std::vector<std::vector<double>> gatewayLinkShadowing;
+    mutable std::unordered_map<uint64_t, double> otherLinkShadowing;
+
+    // Gudmundson-correlated unit-variance field on a regular grid
+    m decorrelationDistance;
+    m fieldResolution;
+    mutable Coord fieldOrigin;
+    mutable int fieldSizeX = 0;
+    mutable int fieldSizeY = 0;
+    mutable std::vector<double> shadowingField;
 
   protected:
     virtual void initialize(int stage) override;
+    virtual double computeFrozenLinkShadowing(const IRadio *transmitter, const IRadio *receiver) const;
+    virtual double computeFieldShadowing(const Coord& transmitterPosition, const Coord& receiverPosition) const;
+    virtual void generateShadowingField() const;
+    virtual void getFieldCell(const Coord& position, int& x, int& y) const;
+    int getRadioSlot(const IRadio *radio) const;
 
   public:
     using FreeSpacePathLoss::computeRange;
     LoRaLogNormalShadowing();
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
     //virtual double computePathLoss(const ITransmission *transmission, const IArrival *arrival) const override;
-    virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
-    m computeRange(W transmissionPower) const;
+    virtual double computeMeanPathLoss(m distance) const override;
+    virtual double computeShadowing(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const override;
+    virtual m computeDistance(double meanPathLoss) const override;
 };
 
 } // namespace inet
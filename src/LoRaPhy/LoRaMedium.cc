@@ -16,6 +16,13 @@
 #include "../LoRa/LoRaMacFrame_m.h"
 #include "LoRaBandListening.h"
 #include "LoRaTransmission.h"
+#include "LoRaReception.h"
+#include "LoRaAnalogModel.h"
+#include "LoRaMediumCache.h"
+#include "LoRaMediumProxy.h"
+#include "LoRaReceiver.h"
+#include "LoRaPhyPreamble_m.h"
+#include "LoRa/LoRaGWRadio.h"
 #include "inet/common/INETUtils.h"
 #include "inet/common/ModuleAccess.h"
 #include "inet/common/Simsignals.h"
@@ -29,6 +36,7 @@
 #include "inet/physicallayer/wireless/common/medium/RadioMedium.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/SignalTag_m.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IErrorModel.h"
+#include "inet/physicallayer/wireless/common/signal/WirelessSignal.h"
 
 namespace flora {
 
@@ -38,8 +46,52 @@ LoRaMedium::LoRaMedium() : RadioMedium()
 {
 }
 
+void LoRaMedium::initialize(int stage)
+{
+    RadioMedium::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        const LoRaMediumCache *cache = dynamic_cast<const LoRaMediumCache *>(mediumLimitCache);
+        if (cache != nullptr && cache->hasInterferenceCutoff()) {
+            loRaMediumCache = cache;
+            WATCH(negligibleInterfererCount);
+        }
+        int collisionThreads = par("collisionThreads");
+        if (collisionThreads > 0)
+            collisionThreadPool = new LoRaThreadPool(collisionThreads, par("collisionChunkSize"));
+        downlinkAddressFilter = par("downlinkAddressFilter");
+        analyticalUplinks = par("analyticalUplinks");
+        if (analyticalUplinks)
+            analyticalNoisePower = mW(math::dBmW2mW(getSubmodule("backgroundNoise")->par("power")));
+    }
+}
+
+void LoRaMedium::handleMessage(cMessage *message)
+{
+    if (message->isSelfMessage() && message != removeNonInterferingTransmissionsTimer) {
+        AnalyticalUplink *uplink = static_cast<AnalyticalUplink *>(message->getContextPointer());
+        delete message;
+        decideAnalyticalUplink(uplink);
+        removeAnalyticalUplinks();
+    }
+    else
+        RadioMedium::handleMessage(message);
+}
+
+void LoRaMedium::finish()
+{
+    RadioMedium::finish();
+    if (loRaMediumCache != nullptr)
+        recordScalar("negligibleInterfererCount", negligibleInterfererCount);
+}
+
 LoRaMedium::~LoRaMedium()
 {
+    delete collisionThreadPool;
+    for (auto uplink : analyticalRecords)
+        deleteAnalyticalUplink(uplink);
+    for (auto &bucket : channelBuckets)
+        for (auto &elem : bucket.second.transmissionIntervals)
+            delete elem.second;
 }
 
 bool LoRaMedium::matchesMacAddressFilter(const IRadio *radio, const Packet *packet) const
@@ -94,30 +146,394 @@ const IReceptionResult *LoRaMedium::getReceptionResult(const IRadio *radio, cons
     return result;
 }
 
+const IReceptionDecision *LoRaMedium::getReceptionDecision(const IRadio *radio, const IListening *listening, const ITransmission *transmission, IRadioSignal::SignalPart part) const
+{
+    if (collisionThreadPool != nullptr && dynamic_cast<const LoRaGWRadio *>(radio) != nullptr && getCachedCollision(radio, transmission) == -1)
+        computeCollisionBatch(transmission);
+    return RadioMedium::getReceptionDecision(radio, listening, transmission, part);
+}
+
+int LoRaMedium::getCachedCollision(const IRadio *radio, const ITransmission *transmission) const
+{
+    auto it = collisionBatches.find(transmission);
+    if (it == collisionBatches.end() || it->second.transmissionCount != transmissionCount)
+        return -1;
+    auto jt = it->second.collided.find(radio->getId());
+    return jt == it->second.collided.end() ? -1 : jt->second;
+}
+
+void LoRaMedium::computeCollisionBatch(const ITransmission *transmission) const
+{
+    // everything that touches the caches or draws random numbers stays on
+    // this thread, in radio id order
+    std::vector<const IRadio *> radios;
+    std::vector<const LoRaReception *> receptions;
+    std::vector<const std::vector<const IReception *> *> interferingReceptions;
+    for (auto radio : radiosById) {
+        if (radio == nullptr || radio->getId() == transmission->getTransmitterId() || dynamic_cast<const LoRaGWRadio *>(radio) == nullptr)
+            continue;
+        if (communicationCache->getCachedArrival(radio, transmission) == nullptr)
+            continue;
+        const LoRaReceiver *receiver = check_and_cast<const LoRaReceiver *>(radio->getReceiver());
+        const LoRaReception *reception = check_and_cast<const LoRaReception *>(getReception(radio, transmission));
+        if (reception->getPower() < receiver->getSensitivity(reception))
+            continue;
+        radios.push_back(radio);
+        receptions.push_back(reception);
+        interferingReceptions.push_back(computeInterferingReceptions(reception));
+    }
+    std::vector<char> collided(radios.size());
+    collisionThreadPool->parallelFor(radios.size(), [&] (int i) {
+        collided[i] = check_and_cast<const LoRaReceiver *>(radios[i]->getReceiver())->computeCollision(receptions[i], interferingReceptions[i]);
+    });
+    CollisionBatch& batch = collisionBatches[transmission];
+    batch.transmissionCount = transmissionCount;
+    batch.collided.clear();
+    for (size_t i = 0; i < radios.size(); i++) {
+        batch.collided[radios[i]->getId()] = collided[i];
+        delete interferingReceptions[i];
+    }
+}
+
+void LoRaMedium::addRadio(const IRadio *radio)
+{
+    RadioMedium::addRadio(radio);
+    if (radio->getId() >= (int)radiosById.size())
+        radiosById.resize(radio->getId() + 1, nullptr);
+    radiosById[radio->getId()] = radio;
+    nodeRadiosByAddress.clear();
+}
+
+void LoRaMedium::removeRadio(const IRadio *radio)
+{
+    RadioMedium::removeRadio(radio);
+    if (radio->getId() < (int)radiosById.size())
+        radiosById[radio->getId()] = nullptr;
+    nodeRadiosByAddress.clear();
+}
+
+IWirelessSignal *LoRaMedium::transmitPacket(const IRadio *radio, Packet *packet)
+{
+    bool fromGateway = dynamic_cast<const LoRaGWRadio *>(radio) != nullptr;
+    if (!fromGateway) {
+        if (analyticalUplinks)
+            return transmitAnalyticalUplink(radio, packet);
+    }
+    else
+        announceDownlink(packet);
+    IWirelessSignal *signal = RadioMedium::transmitPacket(radio, packet);
+    if (mediumProxy != nullptr)
+        mediumProxy->forwardTransmission(signal->getTransmission(), fromGateway);
+    return signal;
+}
+
+void LoRaMedium::setMediumProxy(LoRaMediumProxy *mediumProxy, const IRadio *proxyRadio)
+{
+    // analytical uplinks are decided by the medium of the transmitter, which
+    // cannot see the gateways of other partitions
+    if (analyticalUplinks)
+        throw cRuntimeError("Analytical uplinks are not supported with partitions");
+    this->mediumProxy = mediumProxy;
+    this->proxyRadio = proxyRadio;
+}
+
+void LoRaMedium::addRemoteTransmission(const ITransmission *transmission, Packet *packet, bool fromGateway)
+{
+    Enter_Method("addRemoteTransmission");
+    take(packet);
+    if (fromGateway) {
+        remoteDownlinks.insert(transmission);
+        announceDownlink(packet);
+    }
+    addTransmission(proxyRadio, transmission);
+    // as createTransmitterSignal() would create it for a local transmitter
+    WirelessSignal *signal = new WirelessSignal(transmission);
+    signal->setDuration(transmission->getDuration());
+    signal->setName(packet->getName());
+    signal->encapsulate(packet);
+    communicationCache->setCachedSignal(transmission, signal);
+    // as sendToRadio() does, except that the medium sends the copies, since
+    // the proxy radio only stands in for the transmitter
+    for (auto radio : radiosById) {
+        if (radio == nullptr || radio == proxyRadio || !isPotentialReceiver(radio, transmission))
+            continue;
+        const IArrival *arrival = getArrival(radio, transmission);
+        simtime_t delay = arrival->getStartTime() - simTime();
+        if (delay < 0)
+            throw cRuntimeError("Transmission %d of another partition arrives at %s before it is added, the partition lookahead exceeds the propagation delay plus the capture delay",
+                    transmission->getId(), check_and_cast<const cModule *>(radio)->getFullPath().c_str());
+        WirelessSignal *receivedSignal = signal->dup();
+        cGate *gate = radio->getRadioGate()->getPathStartGate();
+        sendDirect(receivedSignal, delay, transmission->getDuration(), gate);
+        communicationCache->setCachedSignal(radio, transmission, receivedSignal);
+    }
+}
+
+void LoRaMedium::announceDownlink(const Packet *packet)
+{
+    // end devices with analytical RX windows keep their receiver off unless
+    // they know that a downlink for them is on its way
+    MacAddress address = packet->peekAtFront<LoRaPhyPreamble>()->getReceiverAddress();
+    if (address.isBroadcast() || address.isMulticast())
+        return;
+    if (nodeRadiosByAddress.empty()) {
+        for (auto radio : radiosById)
+            if (radio != nullptr && radio != proxyRadio && dynamic_cast<const LoRaGWRadio *>(radio) == nullptr)
+                nodeRadiosByAddress[getRadioAddress(radio)] = const_cast<LoRaRadio *>(check_and_cast<const LoRaRadio *>(radio));
+    }
+    auto it = nodeRadiosByAddress.find(address);
+    if (it != nodeRadiosByAddress.end())
+        it->second->announceDownlink();
+}
+
+IWirelessSignal *LoRaMedium::transmitAnalyticalUplink(const IRadio *radio, Packet *packet)
+{
+    Enter_Method("transmitPacket");
+    if (analyticalGateways.empty()) {
+        for (auto gatewayRadio : radiosById)
+            if (auto gateway = dynamic_cast<const LoRaGWRadio *>(gatewayRadio))
+                analyticalGateways.push_back(const_cast<LoRaGWRadio *>(gateway));
+    }
+    AnalyticalUplink *uplink = new AnalyticalUplink();
+    uplink->signal = createTransmitterSignal(radio, packet);
+    const ITransmission *transmission = uplink->signal->getTransmission();
+    uplink->decisionTime = transmission->getEndTime();
+    for (auto gateway : analyticalGateways) {
+        const IArrival *arrival = propagation->computeArrival(transmission, gateway->getAntenna()->getMobility());
+        uplink->arrivals.push_back(arrival);
+        uplink->receptions.push_back(analogModel->computeReception(gateway, transmission, arrival));
+        uplink->inRange.push_back(isAnalyticalReceiver(transmission, arrival));
+        if (arrival->getEndTime() > uplink->decisionTime)
+            uplink->decisionTime = arrival->getEndTime();
+    }
+    analyticalRecords.push_back(uplink);
+    cMessage *decisionTimer = new cMessage("analyticalDecision");
+    decisionTimer->setContextPointer(uplink);
+    scheduleAt(uplink->decisionTime, decisionTimer);
+    EV_DEBUG << "Transmitting " << transmission << " analytically to " << analyticalGateways.size() << " gateways" << endl;
+    return uplink->signal;
+}
+
+bool LoRaMedium::isAnalyticalReceiver(const ITransmission *transmission, const IArrival *arrival) const
+{
+    // the range filter of isPotentialReceiver(); the mode, listening and
+    // address filters never drop an uplink at a gateway
+    if (rangeFilter == RANGE_FILTER_INTERFERENCE_RANGE)
+        return isInInterferenceRange(transmission, arrival->getStartPosition(), arrival->getEndPosition());
+    else if (rangeFilter == RANGE_FILTER_COMMUNICATION_RANGE)
+        return isInCommunicationRange(transmission, arrival->getStartPosition(), arrival->getEndPosition());
+    else
+        return true;
+}
+
+void LoRaMedium::decideAnalyticalUplink(AnalyticalUplink *uplink)
+{
+    std::vector<const IReception *> interferingReceptions;
+    for (size_t i = 0; i < analyticalGateways.size(); i++) {
+        // gateways out of range never get the signal from the full medium
+        if (!uplink->inRange[i])
+            continue;
+        // the collision model checks the overlap itself, and every uplink
+        // that can overlap this one is still recorded
+        interferingReceptions.clear();
+        for (auto other : analyticalRecords)
+            if (other != uplink)
+                interferingReceptions.push_back(other->receptions[i]);
+        analyticalGateways[i]->handleAnalyticalReception(check_and_cast<const LoRaReception *>(uplink->receptions[i]), &interferingReceptions);
+    }
+}
+
+Packet *LoRaMedium::computeAnalyticalPacket(const LoRaReception *reception) const
+{
+    const Packet *transmittedPacket = reception->getTransmission()->getPacket();
+    Packet *packet = transmittedPacket->dup();
+    packet->clearTags();
+    packet->addTag<PacketProtocolTag>()->setProtocol(transmittedPacket->getTag<PacketProtocolTag>()->getProtocol());
+    packet->addTag<SignalPowerInd>()->setPower(reception->getPower());
+    auto snirInd = packet->addTag<SnirInd>();
+    double snir = unit(reception->getPower() / analyticalNoisePower).get();
+    snirInd->setMinimumSnir(snir);
+    snirInd->setMaximumSnir(snir);
+    auto signalTimeInd = packet->addTag<SignalTimeInd>();
+    signalTimeInd->setStartTime(reception->getStartTime());
+    signalTimeInd->setEndTime(reception->getEndTime());
+    return packet;
+}
+
+void LoRaMedium::removeAnalyticalUplinks()
+{
+    // an uplink can still interfere with anything decided up to one maximal
+    // transmission duration later
+    simtime_t horizon = simTime() - mediumLimitCache->getMaxTransmissionDuration();
+    while (!analyticalRecords.empty() && analyticalRecords.front()->decisionTime < horizon) {
+        deleteAnalyticalUplink(analyticalRecords.front());
+        analyticalRecords.pop_front();
+    }
+}
+
+void LoRaMedium::deleteAnalyticalUplink(AnalyticalUplink *uplink)
+{
+    for (size_t i = 0; i < uplink->receptions.size(); i++) {
+        delete uplink->arrivals[i];
+        delete uplink->receptions[i];
+    }
+    const ITransmission *transmission = uplink->signal->getTransmission();
+    delete uplink->signal;
+    delete transmission;
+    delete uplink;
+}
+
 void LoRaMedium::addTransmission(const IRadio *transmitterRadio, const ITransmission *transmission)
 {
     Enter_Method("addTransmission");
+    const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
+    const LoRaAnalogModel *loRaAnalogModel = check_and_cast<const LoRaAnalogModel *>(analogModel);
     transmissionCount++;
     communicationCache->addTransmission(transmission);
+    simtime_t minArrivalStartTime = SimTime::getMaxTime();
     simtime_t maxArrivalEndTime = transmission->getEndTime();
     communicationCache->mapRadios([&] (const IRadio *receiverRadio) {
-        if (receiverRadio != nullptr && receiverRadio != transmitterRadio && receiverRadio->getReceiver() != nullptr) {
+        if (receiverRadio != nullptr && receiverRadio != transmitterRadio && receiverRadio != proxyRadio && receiverRadio->getReceiver() != nullptr) {
             const IArrival *arrival = propagation->computeArrival(transmission, receiverRadio->getAntenna()->getMobility());
             const IntervalTree::Interval *interval = new IntervalTree::Interval(arrival->getStartTime(), arrival->getEndTime(), (void *)transmission);
-            const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
             LoRaBandListening *loraListening = new LoRaBandListening(receiverRadio, arrival->getStartTime(), arrival->getEndTime(), arrival->getStartPosition(), arrival->getEndPosition(), loRaTransmission->getLoRaCF(), loRaTransmission->getLoRaBW(), loRaTransmission->getLoRaSF());
             const simtime_t arrivalEndTime = arrival->getEndTime();
             if (arrivalEndTime > maxArrivalEndTime)
                 maxArrivalEndTime = arrivalEndTime;
+            if (arrival->getStartTime() < minArrivalStartTime)
+                minArrivalStartTime = arrival->getStartTime();
             communicationCache->setCachedArrival(receiverRadio, transmission, arrival);
             communicationCache->setCachedInterval(receiverRadio, transmission, interval);
             communicationCache->setCachedListening(receiverRadio, transmission, loraListening);
+            // radios that are listening will compute a reception right away, so
+            // fill the transmission's received power table for them here once
+            IRadio::RadioMode radioMode = receiverRadio->getRadioMode();
+            if ((radioMode == IRadio::RADIO_MODE_RECEIVER || radioMode == IRadio::RADIO_MODE_TRANSCEIVER) && !isFilteredDownlinkReceiver(receiverRadio, transmission) && !isNegligibleInterferer(receiverRadio, transmission))
+                loRaAnalogModel->computeReceptionPower(receiverRadio, transmission, arrival);
         }
     });
     communicationCache->setCachedInterferenceEndTime(transmission, maxArrivalEndTime + mediumLimitCache->getMaxTransmissionDuration());
+    if (minArrivalStartTime == SimTime::getMaxTime())
+        minArrivalStartTime = transmission->getStartTime();
+    ChannelBucket& bucket = channelBuckets[std::make_pair(loRaTransmission->getLoRaCF(), loRaTransmission->getLoRaBW())];
+    const IntervalTree::Interval *channelInterval = new IntervalTree::Interval(minArrivalStartTime, maxArrivalEndTime, (void *)transmission);
+    bucket.intervals.insert(channelInterval);
+    bucket.transmissionIntervals[transmission] = channelInterval;
+    bucket.interferenceEndTimes.emplace(communicationCache->getCachedInterferenceEndTime(transmission), transmission);
     if (!removeNonInterferingTransmissionsTimer->isScheduled())
         scheduleAt(communicationCache->getCachedInterferenceEndTime(transmission), removeNonInterferingTransmissionsTimer);
     emit(signalAddedSignal, check_and_cast<const cObject *>(transmission));
 }
 
+bool LoRaMedium::isPotentialReceiver(const IRadio *radio, const ITransmission *transmission) const
+{
+    return radio != proxyRadio && !isFilteredDownlinkReceiver(radio, transmission) && RadioMedium::isPotentialReceiver(radio, transmission);
+}
+
+bool LoRaMedium::isFilteredDownlinkReceiver(const IRadio *radio, const ITransmission *transmission) const
+{
+    if (!downlinkAddressFilter || dynamic_cast<const LoRaGWRadio *>(radio) != nullptr)
+        return false;
+    // uplinks of other end devices are never demodulated by an end device
+    if (!isDownlink(transmission))
+        return true;
+    MacAddress address = transmission->getPacket()->peekAtFront<LoRaPhyPreamble>()->getReceiverAddress();
+    return !address.isBroadcast() && !address.isMulticast() && address != getRadioAddress(radio);
+}
+
+bool LoRaMedium::isDownlink(const ITransmission *transmission) const
+{
+    return dynamic_cast<const LoRaGWRadio *>(getRadioById(transmission->getTransmitterId())) != nullptr || remoteDownlinks.count(transmission) != 0;
+}
+
+const MacAddress& LoRaMedium::getRadioAddress(const IRadio *radio) const
+{
+    if (radio->getId() >= (int)radioAddresses.size())
+        radioAddresses.resize(radio->getId() + 1);
+    MacAddress& address = radioAddresses[radio->getId()];
+    if (address.isUnspecified())
+        address = getContainingNicModule(check_and_cast<const cModule *>(radio))->getMacAddress();
+    return address;
+}
+
+bool LoRaMedium::isNegligibleInterferer(const IRadio *radio, const ITransmission *transmission) const
+{
+    if (loRaMediumCache == nullptr)
+        return false;
+    m cutoffRange = loRaMediumCache->getMaxInterferenceRange(transmission->getPower());
+    if (std::isnan(cutoffRange.get()))
+        return false;
+    const IArrival *arrival = communicationCache->getCachedArrival(radio, transmission);
+    return m(arrival->getStartPosition().distance(transmission->getStartPosition())) > cutoffRange;
+}
+
+std::vector<const ITransmission *> *LoRaMedium::computeChannelInterferingTransmissions(const IRadio *radio, Hz carrierFrequency, Hz bandwidth, simtime_t startTime, simtime_t endTime) const
+{
+    std::vector<const ITransmission *> *interferingTransmissions = new std::vector<const ITransmission *>();
+    auto it = channelBuckets.find(std::make_pair(carrierFrequency, bandwidth));
+    if (it == channelBuckets.end())
+        return interferingTransmissions;
+    // the bucket intervals span the arrivals at every radio, the exact arrival
+    // time at this radio is checked by isInterferingTransmission()
+    std::deque<const IntervalTree::Interval *> intervals = it->second.intervals.query(startTime, endTime);
+    for (auto interval : intervals) {
+        const ITransmission *transmission = (const ITransmission *)interval->value;
+        if (transmission->getTransmitterId() == radio->getId() || communicationCache->getCachedArrival(radio, transmission) == nullptr)
+            continue;
+        if (isNegligibleInterferer(radio, transmission))
+            negligibleInterfererCount++;
+        else
+            interferingTransmissions->push_back(transmission);
+    }
+    // keep the order independent of the tree layout
+    std::sort(interferingTransmissions->begin(), interferingTransmissions->end(), [] (const ITransmission *a, const ITransmission *b) { return a->getId() < b->getId(); });
+    return interferingTransmissions;
+}
+
+const std::vector<const IReception *> *LoRaMedium::computeInterferingReceptions(const IListening *listening) const
+{
+    const IRadio *radio = listening->getReceiver();
+    const LoRaBandListening *loRaListening = check_and_cast<const LoRaBandListening *>(listening);
+    std::vector<const ITransmission *> *interferingTransmissions = computeChannelInterferingTransmissions(radio, loRaListening->getLoRaCF(), loRaListening->getLoRaBW(), listening->getStartTime(), listening->getEndTime());
+    std::vector<const IReception *> *interferingReceptions = new std::vector<const IReception *>();
+    for (const auto interferingTransmission : *interferingTransmissions)
+        if (isInterferingTransmission(interferingTransmission, listening))
+            interferingReceptions->push_back(getReception(radio, interferingTransmission));
+    delete interferingTransmissions;
+    return interferingReceptions;
+}
+
+const std::vector<const IReception *> *LoRaMedium::computeInterferingReceptions(const IReception *reception) const
+{
+    const IRadio *radio = reception->getReceiver();
+    const ITransmission *transmission = reception->getTransmission();
+    const LoRaReception *loRaReception = check_and_cast<const LoRaReception *>(reception);
+    std::vector<const ITransmission *> *interferingTransmissions = computeChannelInterferingTransmissions(radio, loRaReception->getLoRaCF(), loRaReception->getLoRaBW(), reception->getStartTime(), reception->getEndTime());
+    std::vector<const IReception *> *interferingReceptions = new std::vector<const IReception *>();
+    for (const auto interferingTransmission : *interferingTransmissions)
+        if (transmission != interferingTransmission && isInterferingTransmission(interferingTransmission, reception))
+            interferingReceptions->push_back(getReception(radio, interferingTransmission));
+    delete interferingTransmissions;
+    return interferingReceptions;
+}
+
+void LoRaMedium::removeNonInterferingTransmissions()
+{
+    // drop the same transmissions the communication cache is about to delete
+    for (auto &elem : channelBuckets) {
+        ChannelBucket& bucket = elem.second;
+        while (!bucket.interferenceEndTimes.empty() && bucket.interferenceEndTimes.begin()->first <= simTime()) {
+            const ITransmission *transmission = bucket.interferenceEndTimes.begin()->second;
+            auto it = bucket.transmissionIntervals.find(transmission);
+            bucket.intervals.deleteNode(it->second);
+            delete it->second;
+            bucket.transmissionIntervals.erase(it);
+            bucket.interferenceEndTimes.erase(bucket.interferenceEndTimes.begin());
+            collisionBatches.erase(transmission);
+            remoteDownlinks.erase(transmission);
+        }
+    }
+    RadioMedium::removeNonInterferingTransmissions();
+}
+
 }
@@ -29,22 +29,122 @@
 #include "inet/physicallayer/wireless/common/contract/packetlevel/INeighborCache.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 #include <algorithm>
+#include <list>
+#include <set>
+#include "LoRaThreadPool.h"
 
 namespace flora {
+
+class LoRaMediumCache;
+class LoRaMediumProxy;
+class LoRaGWRadio;
+
 class LoRaMedium : public RadioMedium
 {
     friend class LoRaGWRadio;
     friend class LoRaRadio;
 
 protected:
+    /**
+     * Interfering transmissions grouped by (carrier frequency, bandwidth), so
+     * that interference queries never see receptions from other channels.
+     */
+    struct ChannelBucket {
+        IntervalTree intervals;
+        std::map<const ITransmission *, const IntervalTree::Interval *> transmissionIntervals;
+        std::multimap<simtime_t, const ITransmission *> interferenceEndTimes;
+    };
+    mutable std::map<std::pair<Hz, Hz>, ChannelBucket> channelBuckets;
+
+    // registered radios indexed by IRadio::getId(), nullptr for removed ones
+    std::vector<const IRadio *> radiosById;
+
+    // set if the limit cache discards interferers beyond a probabilistic range
+    const LoRaMediumCache *loRaMediumCache = nullptr;
+    mutable long negligibleInterfererCount = 0; // interferers skipped because of that range
+
+    /**
+     * Collision verdicts of all gateways hearing a transmission, evaluated in
+     * parallel when the first of them decides. They are only valid while no
+     * new transmission has been added to the medium. The noise, the SNIR and
+     * the rest of the reception decision are still computed serially by each
+     * gateway, as they use the non thread-safe caches.
+     */
+    struct CollisionBatch {
+        long transmissionCount;
+        std::map<int, bool> collided; // radio id -> verdict
+    };
+    mutable std::map<const ITransmission *, CollisionBatch> collisionBatches;
+    LoRaThreadPool *collisionThreadPool = nullptr;
+
+    /**
+     * An uplink decided analytically: its receptions at the gateways are
+     * computed once and the signal is never sent to any radio. The record
+     * owns the signal, the arrivals and the receptions.
+     */
+    struct AnalyticalUplink {
+        IWirelessSignal *signal = nullptr;
+        std::vector<const IArrival *> arrivals; // indexed like analyticalGateways
+        std::vector<const IReception *> receptions;
+        std::vector<bool> inRange; // the gateways the full medium would send the signal to
+        simtime_t decisionTime;
+    };
+    bool downlinkAddressFilter = false;
+    mutable std::vector<MacAddress> radioAddresses; // by radio id, resolved on first use
+    std::map<MacAddress, LoRaRadio *> nodeRadiosByAddress; // built on the first downlink
+
+    bool analyticalUplinks = false;
+    W analyticalNoisePower = W(NaN);
+    std::vector<LoRaGWRadio *> analyticalGateways;
+    std::list<AnalyticalUplink *> analyticalRecords; // in transmission order
+
+    // set if the radios are split into partitions, see LoRaMediumProxy
+    LoRaMediumProxy *mediumProxy = nullptr;
+    const IRadio *proxyRadio = nullptr; // transmitter of the other partitions' transmissions
+    std::set<const ITransmission *> remoteDownlinks;
+
+protected:
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *message) override;
+    virtual void finish() override;
+    virtual IWirelessSignal *transmitAnalyticalUplink(const IRadio *transmitter, Packet *packet);
+    virtual bool isAnalyticalReceiver(const ITransmission *transmission, const IArrival *arrival) const;
+    virtual void decideAnalyticalUplink(AnalyticalUplink *uplink);
+    virtual void removeAnalyticalUplinks();
+    virtual void deleteAnalyticalUplink(AnalyticalUplink *uplink);
     virtual bool matchesMacAddressFilter(const IRadio *radio, const Packet *packet) const override;
+    virtual const std::vector<const IReception *> *computeInterferingReceptions(const IListening *listening) const override;
+    virtual const std::vector<const IReception *> *computeInterferingReceptions(const IReception *reception) const override;
+    virtual void removeNonInterferingTransmissions() override;
+    virtual void computeCollisionBatch(const ITransmission *transmission) const;
+    virtual bool isNegligibleInterferer(const IRadio *radio, const ITransmission *transmission) const;
+    virtual bool isPotentialReceiver(const IRadio *receiver, const ITransmission *transmission) const override;
+    virtual bool isFilteredDownlinkReceiver(const IRadio *receiver, const ITransmission *transmission) const;
+    virtual bool isDownlink(const ITransmission *transmission) const;
+    virtual void announceDownlink(const Packet *packet);
+    const MacAddress& getRadioAddress(const IRadio *radio) const;
+    virtual std::vector<const ITransmission *> *computeChannelInterferingTransmissions(const IRadio *radio, Hz carrierFrequency, Hz bandwidth, simtime_t startTime, simtime_t endTime) const;
         //@}
     public:
       LoRaMedium();
       virtual ~LoRaMedium();
       //virtual const IReceptionDecision *getReceptionDecision(const IRadio *receiver, const IListening *listening, const ITransmission *transmission, IRadioSignal::SignalPart part) const override;
       virtual const IReceptionResult *getReceptionResult(const IRadio *receiver, const IListening *listening, const ITransmission *transmission) const override;
+      virtual const IReceptionDecision *getReceptionDecision(const IRadio *receiver, const IListening *listening, const ITransmission *transmission, IRadioSignal::SignalPart part) const override;
+      /** Returns 1 or 0 for a valid batched collision verdict, -1 otherwise. */
+      int getCachedCollision(const IRadio *receiver, const ITransmission *transmission) const;
+      /** The packet a gateway receives from an analytically decided uplink. */
+      virtual Packet *computeAnalyticalPacket(const LoRaReception *reception) const;
+      virtual IWirelessSignal *transmitPacket(const IRadio *transmitter, Packet *packet) override;
       virtual void addTransmission(const IRadio *transmitter, const ITransmission *transmission) override;
+      /** Adds a transmission of another partition and sends its signal to the radios. */
+      virtual void addRemoteTransmission(const ITransmission *transmission, Packet *packet, bool fromGateway);
+      virtual void setMediumProxy(LoRaMediumProxy *mediumProxy, const IRadio *proxyRadio);
+      bool isProxyRadio(const IRadio *radio) const { return radio == proxyRadio; }
+      virtual void addRadio(const IRadio *radio) override;
+      virtual void removeRadio(const IRadio *radio) override;
+      const IRadio *getRadioById(int radioId) const { return radioId < (int)radiosById.size() ? radiosById[radioId] : nullptr; }
+      const std::vector<const IRadio *>& getRadiosById() const { return radiosById; }
 };
 }
 #endif /* LORAPHY_LORAMEDIUM_H_ */
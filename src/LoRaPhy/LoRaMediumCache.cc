@@ -18,7 +18,6 @@
 #include <algorithm>
 #include "LoRaPhy/LoRaMediumCache.h"
 #include "LoRaPhy/LoRaMedium.h"
-#include "LoRaPhy/LoRaLogNormalShadowing.h"
 
 namespace flora {
 
@@ -60,8 +59,40 @@ inline double maxIgnoreNaN(double a, double b)
         return b;
 }
 
+/**
+ * Returns x such that P(X > x) = p for a standard normal X, using Acklam's
+ * rational approximation (relative error below 1.2e-9).
+ */
+static double computeStandardNormalTailQuantile(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+    // lower tail quantile of 1 - p, which is the upper tail quantile of p
+    double q = 1 - p;
+    if (q < 0.02425) {
+        double r = sqrt(-2 * log(q));
+        return (((((c[0] * r + c[1]) * r + c[2]) * r + c[3]) * r + c[4]) * r + c[5]) / ((((d[0] * r + d[1]) * r + d[2]) * r + d[3]) * r + 1);
+    }
+    else if (q <= 1 - 0.02425) {
+        double s = q - 0.5;
+        double r = s * s;
+        return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * s / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+    }
+    else {
+        double r = sqrt(-2 * log(p));
+        return -(((((c[0] * r + c[1]) * r + c[2]) * r + c[3]) * r + c[4]) * r + c[5]) / ((((d[0] * r + d[1]) * r + d[2]) * r + d[3]) * r + 1);
+    }
+}
+
 LoRaMediumCache::LoRaMediumCache() :
     radioMedium(nullptr),
+    loRaPathLoss(nullptr),
+    communicationSensitivity(W(NaN)),
+    rangeSigmaMargin(0),
+    interferenceSigmaMargin(0),
+    interferenceCutoff(false),
     minConstraintArea(Coord::NIL),
     maxConstraintArea(Coord::NIL),
     maxSpeed(mps(NaN)),
@@ -80,6 +111,21 @@ void LoRaMediumCache::initialize(int stage)
 {
     if (stage == INITSTAGE_LOCAL) {
         radioMedium = check_and_cast<LoRaMedium *>(getParentModule());
+        loRaPathLoss = dynamic_cast<const LoRaPathLossBase *>(radioMedium->getPathLoss());
+        communicationSensitivity = mW(math::dBmW2mW(par("communicationSensitivity")));
+        rangeSigmaMargin = par("rangeSigmaMargin");
+        double interferenceCutoffProbability = par("interferenceCutoffProbability");
+        if (interferenceCutoffProbability < 0 || interferenceCutoffProbability >= 1)
+            throw cRuntimeError("Invalid interferenceCutoffProbability %g, must be in [0, 1)", interferenceCutoffProbability);
+        interferenceCutoff = interferenceCutoffProbability > 0;
+        if (interferenceCutoff) {
+            if (loRaPathLoss == nullptr)
+                throw cRuntimeError("interferenceCutoffProbability requires a flora path loss model");
+            interferenceSigmaMargin = computeStandardNormalTailQuantile(interferenceCutoffProbability);
+        }
+        else
+            interferenceSigmaMargin = rangeSigmaMargin;
+        WATCH(interferenceSigmaMargin);
         WATCH(minConstraintArea);
         WATCH(maxConstraintArea);
         WATCH(maxSpeed);
@@ -92,6 +138,17 @@ void LoRaMediumCache::initialize(int stage)
         WATCH(maxCommunicationRange);
         WATCH(maxInterferenceRange);
     }
+    else if (stage == INITSTAGE_LAST) {
+        // the radios have registered by now, so the limits are resolved
+        if (interferenceCutoff) {
+            if (std::isnan(minInterferencePower.get()))
+                throw cRuntimeError("interferenceCutoffProbability requires a minInterferencePower, set it on the receivers or on this module");
+            m cutoffRange = getMaxInterferenceRange(maxTransmissionPower);
+            if (!(cutoffRange < m(INFINITY)))
+                throw cRuntimeError("interferenceCutoffProbability %g does not bound the interference range at %g W", par("interferenceCutoffProbability").doubleValue(), maxTransmissionPower.get());
+            EV_INFO << "Ignoring interferers farther than " << cutoffRange << " at the maximum transmission power " << maxTransmissionPower << endl;
+        }
+    }
 }
 
 std::ostream& LoRaMediumCache::printToStream(std::ostream &stream, int level, int evFlags) const
@@ -123,8 +180,9 @@ void LoRaMediumCache::updateLimits()
     maxAntennaGain = computeMaxAntennaGain();
     minInterferenceTime = computeMinInterferenceTime();
     maxTransmissionDuration = computeMaxTransmissionDuration();
-    maxCommunicationRange = getMaxCommunicationRange();
+    maxCommunicationRange = computeMaxCommunicationRange();
     maxInterferenceRange = computeMaxInterferenceRange();
+    interferenceRanges.clear();
 }
 
 void LoRaMediumCache::addRadio(const IRadio *radio)
@@ -189,17 +247,24 @@ double LoRaMediumCache::computeMaxAntennaGain() const
     return maxAntennaGain;
 }
 
-m LoRaMediumCache::computeMaxRange(W maxTransmissionPower, W minReceptionPower) const
+m LoRaMediumCache::computeMaxRange(W maxTransmissionPower, W minReceptionPower, double sigmaMargin) const
 {
+    if (loRaPathLoss != nullptr)
+        return loRaPathLoss->computeRange(maxTransmissionPower * maxAntennaGain * maxAntennaGain, minReceptionPower, sigmaMargin);
     // TODO: this is NaN by default
     Hz carrierFrequency = Hz(par("carrierFrequency"));
     double loss = unit(minReceptionPower / maxTransmissionPower).get() / maxAntennaGain / maxAntennaGain;
     return radioMedium->getPathLoss()->computeRange(radioMedium->getPropagation()->getPropagationSpeed(), carrierFrequency, loss);
 }
 
+m LoRaMediumCache::computeMaxCommunicationRange() const
+{
+    return maxIgnoreNaN(m(par("maxCommunicationRange")), computeMaxRange(maxTransmissionPower, communicationSensitivity, rangeSigmaMargin));
+}
+
 m LoRaMediumCache::computeMaxInterferenceRange() const
 {
-    return maxIgnoreNaN(m(par("maxInterferenceRange")), computeMaxRange(maxTransmissionPower, minInterferencePower));
+    return maxIgnoreNaN(m(par("maxInterferenceRange")), computeMaxRange(maxTransmissionPower, minInterferencePower, interferenceSigmaMargin));
 }
 
 const simtime_t LoRaMediumCache::computeMinInterferenceTime() const
@@ -238,20 +303,30 @@ Coord LoRaMediumCache::computeMaxConstreaintArea() const
 
 m LoRaMediumCache::getMaxInterferenceRange(const IRadio* radio) const
 {
-    m maxInterferenceRange = computeMaxRange(radio->getTransmitter()->getMaxPower(), minInterferencePower);
+    m maxInterferenceRange = computeMaxRange(radio->getTransmitter()->getMaxPower(), minInterferencePower, interferenceSigmaMargin);
     if (!std::isnan(maxInterferenceRange.get()))
         return maxInterferenceRange;
     return radio->getTransmitter()->getMaxInterferenceRange();
 }
 
+m LoRaMediumCache::getMaxInterferenceRange(W transmissionPower) const
+{
+    if (loRaPathLoss == nullptr)
+        return m(NaN);
+    // LoRa transmission powers come in a handful of dBm levels
+    int powerLevel = (int)round(10 * math::mW2dBmW(mW(transmissionPower).get()));
+    auto it = interferenceRanges.find(powerLevel);
+    if (it == interferenceRanges.end())
+        it = interferenceRanges.emplace(powerLevel, computeMaxRange(mW(math::dBmW2mW(powerLevel / 10.0)), minInterferencePower, interferenceSigmaMargin)).first;
+    return it->second;
+}
+
 m LoRaMediumCache::getMaxCommunicationRange(const IRadio* radio) const
 {
-    if (strcmp(radioMedium->par("pathLossType").stringValue(), "LoRaLogNormalShadowing") == 0) {
-        LoRaLogNormalShadowing *loraLogNormalShadowing;
-        loraLogNormalShadowing = check_and_cast<LoRaLogNormalShadowing *>(radioMedium->getSubmodule("pathLoss"));
-        return(loraLogNormalShadowing->computeRange(maxTransmissionPower));
-    }
-    throw cRuntimeError("Unknown pathLossType. Only LoRaLogNormalShadowing is supported by the LoRaMediumCache.");
+    m maxCommunicationRange = computeMaxRange(radio->getTransmitter()->getMaxPower(), communicationSensitivity, rangeSigmaMargin);
+    if (!std::isnan(maxCommunicationRange.get()))
+        return maxCommunicationRange;
+    return radio->getTransmitter()->getMaxCommunicationRange();
 }
 
 } // namespace inet
@@ -21,6 +21,7 @@
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioMedium.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IMediumLimitCache.h"
 #include "LoRaPhy/LoRaMedium.h"
+#include "LoRaPhy/LoRaPathLossBase.h"
 
 namespace flora {
 
@@ -31,6 +32,32 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
      * The corresponding radio medium is never nullptr.
      */
     const LoRaMedium *radioMedium;
+    /**
+     * The path loss model of the medium resolved at initialization, or
+     * nullptr if it is not a flora model with an analytic range.
+     */
+    const LoRaPathLossBase *loRaPathLoss;
+    /**
+     * The reception power below which a signal is not considered for
+     * communication range computation.
+     */
+    W communicationSensitivity;
+    /**
+     * The number of shadowing standard deviations added to the link budget
+     * when computing ranges.
+     */
+    double rangeSigmaMargin;
+    /**
+     * The number of shadowing standard deviations added to the link budget
+     * when computing interference ranges, derived from the configured
+     * interference cutoff probability.
+     */
+    double interferenceSigmaMargin;
+    bool interferenceCutoff;
+    /**
+     * Interference ranges memoized per transmission power in 0.1 dBm steps.
+     */
+    mutable std::map<int, m> interferenceRanges;
 
     /**
      * The list of communicating radios on the medium.
@@ -117,7 +144,8 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
     virtual const simtime_t computeMinInterferenceTime() const;
     virtual const simtime_t computeMaxTransmissionDuration() const;
 
-    virtual m computeMaxRange(W maxTransmissionPower, W minReceptionPower) const;
+    virtual m computeMaxRange(W maxTransmissionPower, W minReceptionPower, double sigmaMargin) const;
+    virtual m computeMaxCommunicationRange() const;
     virtual m computeMaxInterferenceRange() const;
 
     virtual void updateLimits();
@@ -152,6 +180,14 @@ class LoRaMediumCache : public cModule, public IMediumLimitCache
 
     virtual m getMaxCommunicationRange(const IRadio *radio) const override;
     virtual m getMaxInterferenceRange(const IRadio *radio) const override;
+
+    /**
+     * Returns the distance beyond which a signal transmitted with the given
+     * power exceeds the minimum interference power with a probability below
+     * the configured cutoff, or NaN if there is no such cutoff.
+     */
+    virtual m getMaxInterferenceRange(W transmissionPower) const;
+    bool hasInterferenceCutoff() const { return interferenceCutoff; }
     //@}
 };
 
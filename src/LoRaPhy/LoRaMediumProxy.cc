@@ -0,0 +1,261 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#include "LoRaMediumProxy.h"
+#include "LoRaMedium.h"
+#include "LoRaTransmission.h"
+#include "LoRaPhyPreamble_m.h"
+#include "LoRa/LoRaMacFrame_m.h"
+#include "LoRa/LoRaRadio.h"
+#include "LoRaApp/LoRaAppPacket_m.h"
+#include "inet/common/ModuleAccess.h"
+#include "inet/common/ProtocolTag_m.h"
+#include "inet/common/packet/chunk/BitCountChunk.h"
+
+namespace flora {
+
+Define_Module(LoRaMediumProxy);
+
+void LoRaMediumProxy::initialize(int stage)
+{
+    cSimpleModule::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        partition = par("partition");
+        medium = getModuleFromPar<LoRaMedium>(par("radioMediumModule"), this);
+        proxyRadio = getModuleFromPar<LoRaRadio>(par("proxyRadioModule"), this);
+        if (gateSize("out") != gateSize("in"))
+            throw cRuntimeError("The proxy must have one input and one output gate per other partition");
+        medium->setMediumProxy(this, proxyRadio);
+        // the network server and the gateways are in the first partition
+        if (partition == 0)
+            appPacketSentSignal = registerSignal("LoRa_AppPacketSent");
+        else
+            getSimulation()->getSystemModule()->subscribe("LoRa_AppPacketSent", this);
+        WATCH(forwardedCount);
+        WATCH(injectedCount);
+    }
+}
+
+void LoRaMediumProxy::finish()
+{
+    recordScalar("forwardedTransmissions", forwardedCount);
+    recordScalar("injectedTransmissions", injectedCount);
+}
+
+cGate *LoRaMediumProxy::getPartitionGate(int otherPartition)
+{
+    // the network connects the proxies in partition order, skipping itself
+    return gate("out", otherPartition < partition ? otherPartition : otherPartition - 1);
+}
+
+void LoRaMediumProxy::forwardTransmission(const ITransmission *transmission, bool fromGateway)
+{
+    Enter_Method("forwardTransmission");
+    int numGates = gateSize("out");
+    if (numGates == 0)
+        return;
+    LoRaRemoteTransmission *remoteTransmission = createRemoteTransmission(transmission, fromGateway);
+    for (int i = 0; i < numGates - 1; i++)
+        send(remoteTransmission->dup(), "out", i);
+    send(remoteTransmission, "out", numGates - 1);
+    forwardedCount++;
+}
+
+void LoRaMediumProxy::handleMessage(cMessage *message)
+{
+    if (auto remoteTransmission = dynamic_cast<LoRaRemoteTransmission *>(message)) {
+        Packet *packet = createPacket(remoteTransmission);
+        const ITransmission *transmission = createTransmission(remoteTransmission, packet);
+        medium->addRemoteTransmission(transmission, packet, remoteTransmission->getFromGateway());
+        injectedCount++;
+    }
+    else if (auto appPacketSent = dynamic_cast<LoRaRemoteAppPacketSent *>(message)) {
+        // the listeners only count packets sent after the warm-up
+        if (appPacketSent->getSendTime() >= getSimulation()->getWarmupPeriod())
+            emit(appPacketSentSignal, appPacketSent->getSpreadFactor());
+    }
+    else
+        throw cRuntimeError("Unknown message '%s'", message->getName());
+    delete message;
+}
+
+void LoRaMediumProxy::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details)
+{
+    Enter_Method("receiveSignal");
+    LoRaRemoteAppPacketSent *appPacketSent = new LoRaRemoteAppPacketSent("appPacketSent");
+    appPacketSent->setSpreadFactor(value);
+    appPacketSent->setSendTime(simTime());
+    send(appPacketSent, getPartitionGate(0));
+}
+
+LoRaRemoteTransmission *LoRaMediumProxy::createRemoteTransmission(const ITransmission *transmission, bool fromGateway) const
+{
+    const LoRaTransmission *loRaTransmission = check_and_cast<const LoRaTransmission *>(transmission);
+    const Packet *packet = transmission->getPacket();
+    LoRaRemoteTransmission *remoteTransmission = new LoRaRemoteTransmission("remoteTransmission");
+    remoteTransmission->setFromGateway(fromGateway);
+    remoteTransmission->setPacketName(packet->getName());
+    if (auto protocolTag = packet->findTag<PacketProtocolTag>())
+        remoteTransmission->setProtocol(protocolTag->getProtocol()->getName());
+
+    remoteTransmission->setStartTime(transmission->getStartTime());
+    remoteTransmission->setPreambleDuration(transmission->getPreambleDuration());
+    remoteTransmission->setHeaderDuration(transmission->getHeaderDuration());
+    remoteTransmission->setDataDuration(transmission->getDataDuration());
+    const Coord& startPosition = transmission->getStartPosition();
+    const Coord& endPosition = transmission->getEndPosition();
+    remoteTransmission->setStartX(startPosition.x);
+    remoteTransmission->setStartY(startPosition.y);
+    remoteTransmission->setStartZ(startPosition.z);
+    remoteTransmission->setEndX(endPosition.x);
+    remoteTransmission->setEndY(endPosition.y);
+    remoteTransmission->setEndZ(endPosition.z);
+    remoteTransmission->setPower(loRaTransmission->getLoRaTP().get());
+    remoteTransmission->setCenterFrequency(loRaTransmission->getLoRaCF().get());
+    remoteTransmission->setBandwidth(loRaTransmission->getLoRaBW().get());
+    remoteTransmission->setSpreadFactor(loRaTransmission->getLoRaSF());
+    remoteTransmission->setCodeRendundance(loRaTransmission->getLoRaCR());
+
+    const auto& preamble = packet->peekAtFront<LoRaPhyPreamble>();
+    remoteTransmission->setPreambleLength(b(preamble->getChunkLength()).get());
+    remoteTransmission->setPreamblePower(preamble->getPower().get());
+    remoteTransmission->setPreambleUseHeader(preamble->getUseHeader());
+    remoteTransmission->setPreambleReceiverAddress(preamble->getReceiverAddress().getInt());
+
+    b offset = preamble->getChunkLength();
+    const auto& frame = packet->peekAt<LoRaMacFrame>(offset);
+    remoteTransmission->setMacFrameLength(b(frame->getChunkLength()).get());
+    remoteTransmission->setTransmitterAddress(frame->getTransmitterAddress().getInt());
+    remoteTransmission->setReceiverAddress(frame->getReceiverAddress().getInt());
+    remoteTransmission->setSequenceNumber(frame->getSequenceNumber());
+    remoteTransmission->setMacLoRaTP(frame->getLoRaTP());
+    remoteTransmission->setMacLoRaCF(frame->getLoRaCF().get());
+    remoteTransmission->setMacLoRaSF(frame->getLoRaSF());
+    remoteTransmission->setMacLoRaBW(frame->getLoRaBW().get());
+    remoteTransmission->setMacLoRaCR(frame->getLoRaCR());
+    remoteTransmission->setMacLoRaUseHeader(frame->getLoRaUseHeader());
+    remoteTransmission->setRSSI(frame->getRSSI());
+    remoteTransmission->setSNIR(frame->getSNIR());
+    remoteTransmission->setConfirmed(frame->getConfirmed());
+    remoteTransmission->setAck(frame->getAck());
+
+    offset += frame->getChunkLength();
+    b payloadLength = packet->getDataLength() - offset;
+    remoteTransmission->setPayloadLength(payloadLength.get());
+    if (payloadLength > b(0)) {
+        const auto& appPacket = dynamicPtrCast<const LoRaAppPacket>(packet->peekAt(offset, payloadLength));
+        remoteTransmission->setHasAppPacket(appPacket != nullptr);
+        if (appPacket != nullptr) {
+            const LoRaOptions& options = appPacket->getOptions();
+            remoteTransmission->setMsgType(appPacket->getMsgType());
+            remoteTransmission->setSampleMeasurement(appPacket->getSampleMeasurement());
+            remoteTransmission->setOptionsLoRaTP(options.getLoRaTP());
+            remoteTransmission->setOptionsLoRaCF(options.getLoRaCF());
+            remoteTransmission->setOptionsLoRaSF(options.getLoRaSF());
+            remoteTransmission->setOptionsLoRaBW(options.getLoRaBW());
+            remoteTransmission->setOptionsLoRaCR(options.getLoRaCR());
+            remoteTransmission->setOptionsUseHeader(options.getUseHeader());
+            remoteTransmission->setOptionsADRACKReq(options.getADRACKReq());
+        }
+    }
+    return remoteTransmission;
+}
+
+Packet *LoRaMediumProxy::createPacket(const LoRaRemoteTransmission *remoteTransmission) const
+{
+    Packet *packet = new Packet(remoteTransmission->getPacketName());
+
+    auto preamble = makeShared<LoRaPhyPreamble>();
+    preamble->setCenterFrequency(Hz(remoteTransmission->getCenterFrequency()));
+    preamble->setBandwidth(Hz(remoteTransmission->getBandwidth()));
+    preamble->setSpreadFactor(remoteTransmission->getSpreadFactor());
+    preamble->setCodeRendundance(remoteTransmission->getCodeRendundance());
+    preamble->setPower(W(remoteTransmission->getPreamblePower()));
+    preamble->setUseHeader(remoteTransmission->getPreambleUseHeader());
+    preamble->setReceiverAddress(MacAddress(remoteTransmission->getPreambleReceiverAddress()));
+    preamble->setChunkLength(b(remoteTransmission->getPreambleLength()));
+    packet->insertAtBack(preamble);
+
+    auto frame = makeShared<LoRaMacFrame>();
+    frame->setTransmitterAddress(MacAddress(remoteTransmission->getTransmitterAddress()));
+    frame->setReceiverAddress(MacAddress(remoteTransmission->getReceiverAddress()));
+    frame->setSequenceNumber(remoteTransmission->getSequenceNumber());
+    frame->setLoRaTP(remoteTransmission->getMacLoRaTP());
+    frame->setLoRaCF(Hz(remoteTransmission->getMacLoRaCF()));
+    frame->setLoRaSF(remoteTransmission->getMacLoRaSF());
+    frame->setLoRaBW(Hz(remoteTransmission->getMacLoRaBW()));
+    frame->setLoRaCR(remoteTransmission->getMacLoRaCR());
+    frame->setLoRaUseHeader(remoteTransmission->getMacLoRaUseHeader());
+    frame->setRSSI(remoteTransmission->getRSSI());
+    frame->setSNIR(remoteTransmission->getSNIR());
+    frame->setConfirmed(remoteTransmission->getConfirmed());
+    frame->setAck(remoteTransmission->getAck());
+    frame->setChunkLength(b(remoteTransmission->getMacFrameLength()));
+    packet->insertAtBack(frame);
+
+    b payloadLength = b(remoteTransmission->getPayloadLength());
+    if (remoteTransmission->getHasAppPacket()) {
+        auto appPacket = makeShared<LoRaAppPacket>();
+        appPacket->setMsgType(remoteTransmission->getMsgType());
+        appPacket->setSampleMeasurement(remoteTransmission->getSampleMeasurement());
+        LoRaOptions& options = appPacket->getOptionsForUpdate();
+        options.setLoRaTP(remoteTransmission->getOptionsLoRaTP());
+        options.setLoRaCF(remoteTransmission->getOptionsLoRaCF());
+        options.setLoRaSF(remoteTransmission->getOptionsLoRaSF());
+        options.setLoRaBW(remoteTransmission->getOptionsLoRaBW());
+        options.setLoRaCR(remoteTransmission->getOptionsLoRaCR());
+        options.setUseHeader(remoteTransmission->getOptionsUseHeader());
+        options.setADRACKReq(remoteTransmission->getOptionsADRACKReq());
+        appPacket->setChunkLength(payloadLength);
+        packet->insertAtBack(appPacket);
+    }
+    else if (payloadLength > b(0))
+        packet->insertAtBack(makeShared<BitCountChunk>(payloadLength));
+
+    if (strcmp(remoteTransmission->getProtocol(), ""))
+        packet->addTag<PacketProtocolTag>()->setProtocol(Protocol::getProtocol(remoteTransmission->getProtocol()));
+    return packet;
+}
+
+const ITransmission *LoRaMediumProxy::createTransmission(const LoRaRemoteTransmission *remoteTransmission, const Packet *packet) const
+{
+    simtime_t startTime = remoteTransmission->getStartTime();
+    simtime_t preambleDuration = remoteTransmission->getPreambleDuration();
+    simtime_t headerDuration = remoteTransmission->getHeaderDuration();
+    simtime_t dataDuration = remoteTransmission->getDataDuration();
+    // as LoRaTransmitter::createTransmission() sums them up
+    simtime_t endTime = startTime + (preambleDuration + headerDuration + dataDuration);
+    Coord startPosition(remoteTransmission->getStartX(), remoteTransmission->getStartY(), remoteTransmission->getStartZ());
+    Coord endPosition(remoteTransmission->getEndX(), remoteTransmission->getEndY(), remoteTransmission->getEndZ());
+    return new LoRaTransmission(proxyRadio,
+            packet,
+            startTime,
+            endTime,
+            preambleDuration,
+            headerDuration,
+            dataDuration,
+            startPosition,
+            endPosition,
+            Quaternion::IDENTITY,
+            Quaternion::IDENTITY,
+            W(remoteTransmission->getPower()),
+            Hz(remoteTransmission->getCenterFrequency()),
+            remoteTransmission->getSpreadFactor(),
+            Hz(remoteTransmission->getBandwidth()),
+            remoteTransmission->getCodeRendundance());
+}
+
+} // namespace flora
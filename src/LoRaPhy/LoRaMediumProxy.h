@@ -0,0 +1,84 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#ifndef LORAPHY_LORAMEDIUMPROXY_H_
+#define LORAPHY_LORAMEDIUMPROXY_H_
+
+#include "inet/common/INETDefs.h"
+#include "inet/common/packet/Packet.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/ITransmission.h"
+#include "LoRaRemoteTransmission_m.h"
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+class LoRaMedium;
+class LoRaRadio;
+
+/**
+ * Connects the LoRaMedium of one geographic partition to the media of the
+ * other partitions, so that the partitions can run under OMNeT++ parallel
+ * simulation. The INET medium calls into all radios directly and shares its
+ * transmission objects between them, which cannot cross partitions, so every
+ * local transmission is flattened into a LoRaRemoteTransmission and sent to
+ * the proxies of the other partitions. These rebuild the packet and the
+ * transmission, with the proxy radio of their partition as the transmitter,
+ * and add it to their own medium, which sends the signal to its radios.
+ *
+ * The links between the proxies have the partition lookahead as their delay.
+ * A remote transmission thus arrives one lookahead after it started, which
+ * must not be later than its arrival at any radio of the partition, i.e. the
+ * lookahead must not exceed the minimum propagation delay between partitions
+ * plus the capture delay of LoRaPropagation. LoRaDeployment computes it.
+ *
+ * The proxies of the other partitions also relay the LoRa_AppPacketSent
+ * signals of their nodes to the first partition, where the network server
+ * and the gateways count them.
+ */
+class LoRaMediumProxy : public cSimpleModule, public cListener
+{
+  public:
+    using cIListener::finish;
+
+  protected:
+    int partition = -1;
+    LoRaMedium *medium = nullptr;
+    LoRaRadio *proxyRadio = nullptr;
+    simsignal_t appPacketSentSignal = -1;
+    long forwardedCount = 0;
+    long injectedCount = 0;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *message) override;
+    virtual void finish() override;
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
+
+    cGate *getPartitionGate(int otherPartition);
+    virtual LoRaRemoteTransmission *createRemoteTransmission(const ITransmission *transmission, bool fromGateway) const;
+    virtual Packet *createPacket(const LoRaRemoteTransmission *remoteTransmission) const;
+    virtual const ITransmission *createTransmission(const LoRaRemoteTransmission *remoteTransmission, const Packet *packet) const;
+
+  public:
+    /** Sends a transmission of this partition to the other partitions. */
+    virtual void forwardTransmission(const ITransmission *transmission, bool fromGateway);
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAMEDIUMPROXY_H_ */
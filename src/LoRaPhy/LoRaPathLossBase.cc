@@ -0,0 +1,64 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#include "LoRaPathLossBase.h"
+#include "inet/common/INETMath.h"
+
+namespace flora {
+
+void LoRaPathLossBase::initialize(int stage)
+{
+    FreeSpacePathLoss::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        if (par("useCounterRng")) {
+            // the key still follows the configured seed of the run
+            uint64_t seed = ((uint64_t)getRNG(0)->intRand() << 32) | getRNG(0)->intRand();
+            counterRng = new LoRaCounterRng(seed);
+        }
+    }
+}
+
+double LoRaPathLossBase::drawShadowing(uint64_t a, uint64_t b) const
+{
+    if (sigma <= 0)
+        return 0;
+    return counterRng != nullptr ? counterRng->normal(a, b, 0.0, sigma) : normal(0.0, sigma);
+}
+
+double LoRaPathLossBase::computeShadowing(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const
+{
+    return drawShadowing(transmission->getId(), receiver->getId());
+}
+
+m LoRaPathLossBase::computeRange(W transmissionPower, W sensitivity, double sigmaMargin) const
+{
+    double maxPathLoss = math::mW2dBmW(mW(transmissionPower).get()) - math::mW2dBmW(mW(sensitivity).get()) + sigmaMargin * sigma;
+    return computeDistance(maxPathLoss);
+}
+
+double LoRaPathLossBase::computePathLoss(mps propagationSpeed, Hz frequency, m distance) const
+{
+    double PL_db = computeMeanPathLoss(distance) + (sigma > 0 ? normal(0.0, sigma) : 0);
+    return math::dB2fraction(-PL_db);
+}
+
+double LoRaPathLossBase::computePathLoss(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const
+{
+    m distance = m(arrival->getStartPosition().distance(transmission->getStartPosition()));
+    double PL_db = computeMeanPathLoss(distance) + computeShadowing(transmission, receiver, arrival);
+    return math::dB2fraction(-PL_db);
+}
+
+}
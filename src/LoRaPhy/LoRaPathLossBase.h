@@ -0,0 +1,78 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef LORAPHY_LORAPATHLOSSBASE_H_
+#define LORAPHY_LORAPATHLOSSBASE_H_
+
+#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "inet/physicallayer/wireless/common/contract/packetlevel/IRadio.h"
+#include "LoRaCounterRng.h"
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+/**
+ * Common base of the flora path loss models. The loss is split into a
+ * deterministic mean part, which depends on the distance only, and a random
+ * shadowing part, so that the mean can be precomputed for static links.
+ */
+class LoRaPathLossBase : public FreeSpacePathLoss
+{
+  protected:
+    double sigma = 0;
+    // set if shadowing is drawn from counter based streams
+    LoRaCounterRng *counterRng = nullptr;
+
+  protected:
+    virtual void initialize(int stage) override;
+
+    /**
+     * Draws a N(0, sigma) shadowing value. With counter based streams the
+     * value only depends on the (a, b) pair, e.g. transmission and receiver
+     * ids, otherwise it is the next draw of the module RNG.
+     */
+    double drawShadowing(uint64_t a, uint64_t b) const;
+
+  public:
+    virtual ~LoRaPathLossBase() { delete counterRng; }
+
+    using FreeSpacePathLoss::computePathLoss;
+
+    /** Returns the mean path loss in dB at the given distance. */
+    virtual double computeMeanPathLoss(m distance) const = 0;
+
+    /** Returns the distance at which the mean path loss reaches the given value in dB. */
+    virtual m computeDistance(double meanPathLoss) const = 0;
+
+    /** Returns the random part of the path loss in dB for one reception. */
+    virtual double computeShadowing(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const;
+
+    virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
+    virtual double computePathLoss(const ITransmission *transmission, const IRadio *receiver, const IArrival *arrival) const;
+
+    /**
+     * Returns the distance beyond which a signal transmitted with the given
+     * power arrives below the given sensitivity, even when shadowing reduces
+     * the loss by sigmaMargin standard deviations.
+     */
+    virtual m computeRange(W transmissionPower, W sensitivity, double sigmaMargin) const;
+
+    double getSigma() const { return sigma; }
+};
+
+} // namespace inet
+
+#endif /* LORAPHY_LORAPATHLOSSBASE_H_ */
@@ -25,7 +25,7 @@ LoRaPathLossOulu::LoRaPathLossOulu()
 
 void LoRaPathLossOulu::initialize(int stage)
 {
-    FreeSpacePathLoss::initialize(stage);
+    LoRaPathLossBase::initialize(stage);
     if (stage == INITSTAGE_LOCAL) {
         d0 = m(par("d0"));
         n = par("n");
@@ -35,13 +35,15 @@ void LoRaPathLossOulu::initialize(int stage)
     }
 }
 
-double LoRaPathLossOulu::computePathLoss(mps propagationSpeed, Hz frequency, m distance) const
+double LoRaPathLossOulu::computeMeanPathLoss(m distance) const
 {
     //EPL = B + 10nlog10( d / d0 )
-    //double PL_d0_db = 127.41;
-    //double PL_db = PL_d0_db + 10 * gamma * log10(unit(distance / d0).get()) + normal(0.0, sigma);
-    double PL_db = B + 10 * n * log10(unit(distance/d0).get()) - antennaGain + normal(0.0, sigma);
-    return math::dB2fraction(-PL_db);
+    return B + 10 * n * log10(unit(distance/d0).get()) - antennaGain;
+}
+
+m LoRaPathLossOulu::computeDistance(double meanPathLoss) const
+{
+    return d0 * pow(10, (meanPathLoss - B + antennaGain) / (10 * n));
 }
 
 }
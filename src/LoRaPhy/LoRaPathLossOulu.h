@@ -16,7 +16,7 @@
 #ifndef LORAPHY_LORAPATHLOSSOULU_H_
 #define LORAPHY_LORAPATHLOSSOULU_H_
 
-#include "inet/physicallayer/wireless/common/pathloss/FreeSpacePathLoss.h"
+#include "LoRaPathLossBase.h"
 
 using namespace inet;
 using namespace inet::physicallayer;
@@ -25,13 +25,12 @@ namespace flora {
 /**
  * This class implements the log normal shadowing model.
  */
-class LoRaPathLossOulu : public FreeSpacePathLoss
+class LoRaPathLossOulu : public LoRaPathLossBase
 {
   protected:
     m d0;
     double n;
     double B;
-    double sigma;
     double antennaGain;
 
   protected:
@@ -39,7 +38,8 @@ class LoRaPathLossOulu : public FreeSpacePathLoss
 
   public:
     LoRaPathLossOulu();
-    virtual double computePathLoss(mps propagationSpeed, Hz frequency, m distance) const override;
+    virtual double computeMeanPathLoss(m distance) const override;
+    virtual m computeDistance(double meanPathLoss) const override;
 };
 
 } // namespace inet
@@ -0,0 +1,56 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#include "LoRaPropagation.h"
+#include "inet/physicallayer/wireless/common/signal/Arrival.h"
+
+namespace flora {
+
+Define_Module(LoRaPropagation);
+
+void LoRaPropagation::initialize(int stage)
+{
+    ConstantSpeedPropagation::initialize(stage);
+    if (stage == INITSTAGE_LOCAL) {
+        captureDelay = par("captureDelay");
+        if (captureDelay < 0)
+            throw cRuntimeError("Negative captureDelay");
+    }
+}
+
+std::ostream& LoRaPropagation::printToStream(std::ostream& stream, int level, int evFlags) const
+{
+    stream << "LoRaPropagation";
+    if (level <= PRINT_LEVEL_TRACE)
+        stream << ", propagationSpeed = " << propagationSpeed
+               << ", captureDelay = " << captureDelay;
+    return stream;
+}
+
+const IArrival *LoRaPropagation::computeArrival(const ITransmission *transmission, IMobility *mobility) const
+{
+    const IArrival *arrival = ConstantSpeedPropagation::computeArrival(transmission, mobility);
+    if (captureDelay == 0)
+        return arrival;
+    const IArrival *capturedArrival = new Arrival(arrival->getStartPropagationTime() + captureDelay, arrival->getEndPropagationTime() + captureDelay,
+            arrival->getStartTime() + captureDelay, arrival->getEndTime() + captureDelay,
+            arrival->getPreambleDuration(), arrival->getHeaderDuration(), arrival->getDataDuration(),
+            arrival->getStartPosition(), arrival->getEndPosition(), arrival->getStartOrientation(), arrival->getEndOrientation());
+    delete arrival;
+    return capturedArrival;
+}
+
+} // namespace flora
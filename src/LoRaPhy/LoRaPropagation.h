@@ -0,0 +1,51 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+
+#ifndef LORAPHY_LORAPROPAGATION_H_
+#define LORAPHY_LORAPROPAGATION_H_
+
+#include "inet/physicallayer/wireless/common/propagation/ConstantSpeedPropagation.h"
+
+using namespace inet;
+using namespace inet::physicallayer;
+namespace flora {
+
+/**
+ * Constant speed propagation where every arrival starts and ends a fixed
+ * capture delay later. It models the preamble symbols a receiver has to
+ * detect before a signal can affect it. As the delay is the same at every
+ * receiver, the overlaps between signals and thus the collisions stay the
+ * same, but a transmission can never affect another radio before that delay,
+ * however close the two are. Partitioned runs use this as the lookahead.
+ */
+class LoRaPropagation : public ConstantSpeedPropagation
+{
+  protected:
+    simtime_t captureDelay;
+
+  protected:
+    virtual void initialize(int stage) override;
+
+  public:
+    virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
+    virtual const IArrival *computeArrival(const ITransmission *transmission, IMobility *mobility) const override;
+
+    simtime_t getCaptureDelay() const { return captureDelay; }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORAPROPAGATION_H_ */
@@ -15,6 +15,7 @@
 
 #include "LoRaReceiver.h"
 #include "LoRaReception.h"
+#include "LoRaMedium.h"
 #include "inet/physicallayer/wireless/common/analogmodel/packetlevel/ScalarNoise.h"
 #include "../LoRaApp/SimpleLoRaApp.h"
 #include "LoRaPhyPreamble_m.h"
@@ -25,7 +26,8 @@ namespace flora {
 Define_Module(LoRaReceiver);
 
 LoRaReceiver::LoRaReceiver() :
-    snirThreshold(NaN)
+    snirThreshold(NaN),
+    minInterferencePower(W(NaN))
 {
 }
 
@@ -36,6 +38,7 @@ void LoRaReceiver::initialize(int stage)
     {
         snirThreshold = math::dB2fraction(par("snirThreshold"));
         energyDetection = mW(math::dBmW2mW(par("energyDetection")));
+        minInterferencePower = mW(math::dBmW2mW(par("minInterferencePower")));
         if(strcmp(getParentModule()->getClassName(), "flora::LoRaGWRadio") == 0)
         {
             iAmGateway = true;
@@ -76,14 +79,61 @@ bool LoRaReceiver::computeIsReceptionPossible(const IListening *listening, const
     if (iAmGateway == false && (loRaListening->getLoRaCF() != loRaReception->getLoRaCF() || loRaListening->getLoRaBW() != loRaReception->getLoRaBW() || loRaListening->getLoRaSF() != loRaReception->getLoRaSF())) {
         return false;
     } else {
-        W minReceptionPower = loRaReception->computeMinPower(reception->getStartTime(part), reception->getEndTime(part));
-        W sensitivity = getSensitivity(loRaReception);
-        bool isReceptionPossible = minReceptionPower >= sensitivity;
-        EV_DEBUG << "Computing whether reception is possible: minimum reception power = " << minReceptionPower << ", sensitivity = " << sensitivity << " -> reception is " << (isReceptionPossible ? "possible" : "impossible") << endl;
-        if(isReceptionPossible == false) {
-           const_cast<LoRaReceiver* >(this)->rcvBelowSensitivity++;
+        return isAboveSensitivity(loRaReception, reception->getStartTime(part), reception->getEndTime(part));
+    }
+}
+
+bool LoRaReceiver::isAboveSensitivity(const LoRaReception *loRaReception, simtime_t startTime, simtime_t endTime) const
+{
+    W minReceptionPower = loRaReception->computeMinPower(startTime, endTime);
+    W sensitivity = getSensitivity(loRaReception);
+    bool isReceptionPossible = minReceptionPower >= sensitivity;
+    EV_DEBUG << "Computing whether reception is possible: minimum reception power = " << minReceptionPower << ", sensitivity = " << sensitivity << " -> reception is " << (isReceptionPossible ? "possible" : "impossible") << endl;
+    if(isReceptionPossible == false) {
+       const_cast<LoRaReceiver* >(this)->rcvBelowSensitivity++;
+    }
+    return isReceptionPossible;
+}
+
+bool LoRaReceiver::computeIsAnalyticalReceptionSuccessful(const LoRaReception *loRaReception, const std::vector<const IReception *> *interferingReceptions) const
+{
+    // the whole signal part of computeReceptionDecision(), with the same
+    // statistics
+    if (!isAboveSensitivity(loRaReception, loRaReception->getStartTime(), loRaReception->getEndTime()))
+        return false;
+    if (computeCollision(loRaReception, interferingReceptions)) {
+        if (iAmGateway)
+            const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
+        countCollision(loRaReception);
+        return false;
+    }
+    return true;
+}
+
+void LoRaReceiver::countCollision(const IReception *reception) const
+{
+    auto packet = reception->getTransmission()->getPacket();
+    const auto &chunk = packet->peekAtFront<FieldsChunk>();
+    auto loraMac = dynamicPtrCast<const LoRaMacFrame>(chunk);
+    auto loraPreamble = dynamicPtrCast<const LoRaPhyPreamble>(chunk);
+    MacAddress rec;
+    if (loraPreamble)
+        rec = loraPreamble->getReceiverAddress();
+    else if (loraMac)
+        rec = loraMac->getReceiverAddress();
+
+    if (iAmGateway == false) {
+        auto *macLayer = check_and_cast<LoRaMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
+        if (rec == macLayer->getAddress()) {
+            const_cast<LoRaReceiver* >(this)->numCollisions++;
+        }
+        //EV << "Node: Extracted macFrame = " << loraMacFrame->getReceiverAddress() << ", node address = " << macLayer->getAddress() << std::endl;
+    } else {
+        auto *gwMacLayer = check_and_cast<LoRaGWMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
+        EV << "GW: Extracted macFrame = " << rec << ", node address = " << gwMacLayer->getAddress() << std::endl;
+        if (rec == MacAddress::BROADCAST_ADDRESS) {
+            const_cast<LoRaReceiver* >(this)->numCollisions++;
         }
-        return isReceptionPossible;
     }
 }
 
@@ -91,29 +141,7 @@ bool LoRaReceiver::computeIsReceptionAttempted(const IListening *listening, cons
 {
     if(isPacketCollided(reception, part, interference))
     {
-        auto packet = reception->getTransmission()->getPacket();
-        const auto &chunk = packet->peekAtFront<FieldsChunk>();
-        auto loraMac = dynamicPtrCast<const LoRaMacFrame>(chunk);
-        auto loraPreamble = dynamicPtrCast<const LoRaPhyPreamble>(chunk);
-        MacAddress rec;
-        if (loraPreamble)
-            rec = loraPreamble->getReceiverAddress();
-        else if (loraMac)
-            rec = loraMac->getReceiverAddress();
-
-        if (iAmGateway == false) {
-            auto *macLayer = check_and_cast<LoRaMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
-            if (rec == macLayer->getAddress()) {
-                const_cast<LoRaReceiver* >(this)->numCollisions++;
-            }
-            //EV << "Node: Extracted macFrame = " << loraMacFrame->getReceiverAddress() << ", node address = " << macLayer->getAddress() << std::endl;
-        } else {
-            auto *gwMacLayer = check_and_cast<LoRaGWMac *>(getParentModule()->getParentModule()->getSubmodule("mac"));
-            EV << "GW: Extracted macFrame = " << rec << ", node address = " << gwMacLayer->getAddress() << std::endl;
-            if (rec == MacAddress::BROADCAST_ADDRESS) {
-                const_cast<LoRaReceiver* >(this)->numCollisions++;
-            }
-        }
+        countCollision(reception);
         return false;
     } else {
         return true;
@@ -122,86 +150,52 @@ bool LoRaReceiver::computeIsReceptionAttempted(const IListening *listening, cons
 
 bool LoRaReceiver::isPacketCollided(const IReception *reception, IRadioSignal::SignalPart part, const IInterference *interference) const
 {
-    //auto radio = reception->getReceiver();
-    //auto radioMedium = radio->getMedium();
-    auto interferingReceptions = interference->getInterferingReceptions();
     const LoRaReception *loRaReception = check_and_cast<const LoRaReception *>(reception);
+    EV << "Czas transmisji to " << loRaReception->getEndTime() - loRaReception->getStartTime() << endl;
+    // the medium may have evaluated this reception together with the other
+    // gateways hearing the same transmission already
+    const LoRaMedium *medium = check_and_cast<const LoRaMedium *>(reception->getReceiver()->getMedium());
+    int cachedCollision = medium->getCachedCollision(reception->getReceiver(), reception->getTransmission());
+    bool collided = cachedCollision != -1 ? cachedCollision == 1 : computeCollision(loRaReception, interference->getInterferingReceptions());
+    EV << "[MSDEBUG] Received packet at SF: " << loRaReception->getLoRaSF() << " with power " << loRaReception->getPowerDbm() << (collided ? " is discarded" : " is not discarded") << endl;
+    if (collided && iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE))
+        const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
+    return collided;
+}
+
+bool LoRaReceiver::computeCollision(const LoRaReception *loRaReception, const std::vector<const IReception *> *interferingReceptions) const
+{
     simtime_t m_x = (loRaReception->getStartTime() + loRaReception->getEndTime())/2;
     simtime_t d_x = (loRaReception->getEndTime() - loRaReception->getStartTime())/2;
-    EV << "Czas transmisji to " << loRaReception->getEndTime() - loRaReception->getStartTime() << endl;
-    // double P_threshold = 6;
-    W signalRSSI_w = loRaReception->getPower();
-    double signalRSSI_mw = signalRSSI_w.get()*1000;
-    double signalRSSI_dBm = math::mW2dBmW(signalRSSI_mw);
-    EV << signalRSSI_mw << endl;
-    EV << signalRSSI_dBm << endl;
+    double signalRSSI_dBm = loRaReception->getPowerDbm();
     int receptionSF = loRaReception->getLoRaSF();
+    Hz receptionCF = loRaReception->getLoRaCF();
+    Hz receptionBW = loRaReception->getLoRaBW();
+    /* If last 6 symbols of preamble are received, no collision*/
+    double nPreamble = 8; //from the paper "Do Lora networks..."
+    simtime_t Tsym = (pow(2, loRaReception->getLoRaSF()))/(loRaReception->getLoRaBW().get()/1000)/1000;
+    simtime_t csBegin = loRaReception->getPreambleStartTime() + Tsym * (nPreamble - 6);
     for (auto interferingReception : *interferingReceptions) {
-        bool overlap = false;
-        bool frequencyCollision = false;
-        bool captureEffect = false;
-        bool timingCollision = false; //Collision is acceptable in first part of preamble
         const LoRaReception *loRaInterference = check_and_cast<const LoRaReception *>(interferingReception);
+        // only receptions in the same (CF, BW) bucket can collide
+        if (loRaInterference->getLoRaCF() != receptionCF || loRaInterference->getLoRaBW() != receptionBW)
+            continue;
 
         simtime_t m_y = (loRaInterference->getStartTime() + loRaInterference->getEndTime())/2;
         simtime_t d_y = (loRaInterference->getEndTime() - loRaInterference->getStartTime())/2;
-        if(omnetpp::fabs(m_x - m_y) < d_x + d_y)
-        {
-            overlap = true;
-        }
-
-        if(loRaReception->getLoRaCF() == loRaInterference->getLoRaCF())
-        {
-            frequencyCollision = true;
-        }
-
-        W interferenceRSSI_w = loRaInterference->getPower();
-        double interferenceRSSI_mw = interferenceRSSI_w.get()*1000;
-        double interferenceRSSI_dBm = math::mW2dBmW(interferenceRSSI_mw);
-        int interferenceSF = loRaInterference->getLoRaSF();
+        bool overlap = omnetpp::fabs(m_x - m_y) < d_x + d_y;
+        if (!overlap)
+            continue;
+        if (alohaChannelModel)
+            return true;
 
         /* If difference in power between two signals is greater than threshold, no collision*/
-        if(signalRSSI_dBm - interferenceRSSI_dBm >= nonOrthDelta[receptionSF-7][interferenceSF-7])
-        {
-            captureEffect = true;
-        }
-
-        EV << "[MSDEBUG] Received packet at SF: " << receptionSF << " with power " << signalRSSI_dBm << endl;
-        EV << "[MSDEBUG] Received interference at SF: " << interferenceSF << " with power " << interferenceRSSI_dBm << endl;
-        EV << "[MSDEBUG] Acceptable diff is equal " << nonOrthDelta[receptionSF-7][interferenceSF-7] << endl;
-        EV << "[MSDEBUG] Diff is equal " << signalRSSI_dBm - interferenceRSSI_dBm << endl;
-        if (captureEffect == false)
-        {
-            EV << "[MSDEBUG] Packet is discarded" << endl;
-        } else
-            EV << "[MSDEBUG] Packet is not discarded" << endl;
-
-        /* If last 6 symbols of preamble are received, no collision*/
-        double nPreamble = 8; //from the paper "Do Lora networks..."
-        simtime_t Tsym = (pow(2, loRaReception->getLoRaSF()))/(loRaReception->getLoRaBW().get()/1000)/1000;
-        simtime_t csBegin = loRaReception->getPreambleStartTime() + Tsym * (nPreamble - 6);
-        if(csBegin < loRaInterference->getEndTime())
-        {
-            timingCollision = true;
-        }
-
-        if (overlap && frequencyCollision)
-        {
-            if(alohaChannelModel == true)
-            {
-                if(iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE)) const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
-                return true;
-            }
-            if(alohaChannelModel == false)
-            {
-                if(captureEffect == false && timingCollision)
-                {
-                    if(iAmGateway && (part == IRadioSignal::SIGNAL_PART_DATA || part == IRadioSignal::SIGNAL_PART_WHOLE)) const_cast<LoRaReceiver* >(this)->emit(LoRaReceptionCollision, true);
-                    return true;
-                }
-            }
-
-        }
+        double interferenceRSSI_dBm = loRaInterference->getPowerDbm();
+        int interferenceSF = loRaInterference->getLoRaSF();
+        bool captureEffect = signalRSSI_dBm - interferenceRSSI_dBm >= nonOrthDelta[receptionSF-7][interferenceSF-7];
+        bool timingCollision = csBegin < loRaInterference->getEndTime(); //Collision is acceptable in first part of preamble
+        if (captureEffect == false && timingCollision)
+            return true;
     }
     return false;
 }
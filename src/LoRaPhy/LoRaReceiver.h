@@ -53,6 +53,7 @@ private:
     double LoRaCR;
 
     double snirThreshold;
+    W minInterferencePower;
 
     bool iAmGateway;
     bool alohaChannelModel;
@@ -77,7 +78,7 @@ public:
 
   void initialize(int stage) override;
   void finish() override;
-  virtual W getMinInterferencePower() const override { return W(NaN); }
+  virtual W getMinInterferencePower() const override { return minInterferencePower; }
   virtual W getMinReceptionPower() const override { return W(NaN); }
 
   virtual bool computeIsReceptionPossible(const IListening *listening, const ITransmission *transmission) const override;
@@ -100,6 +101,20 @@ public:
   W getSensitivity(const LoRaReception *loRaReception) const;
 
   bool isPacketCollided(const IReception *reception, IRadioSignal::SignalPart part, const IInterference *interference) const;
+  bool isAboveSensitivity(const LoRaReception *loRaReception, simtime_t startTime, simtime_t endTime) const;
+  void countCollision(const IReception *reception) const;
+
+  /**
+   * Decides an uplink the medium evaluates analytically, updating the same
+   * statistics and signals as a reception through the medium.
+   */
+  bool computeIsAnalyticalReceptionSuccessful(const LoRaReception *loRaReception, const std::vector<const IReception *> *interferingReceptions) const;
+
+  /**
+   * Returns whether any of the interfering receptions destroys the reception.
+   * Free of side effects, so the medium may evaluate it on worker threads.
+   */
+  bool computeCollision(const LoRaReception *loRaReception, const std::vector<const IReception *> *interferingReceptions) const;
 
   virtual void setLoRaTP(W newTP) { LoRaTP = newTP; };
   virtual void setLoRaCF(Hz newCF) { LoRaCF = newCF; };
@@ -9,13 +9,14 @@
 
 namespace flora {
 
-LoRaReception::LoRaReception(const IRadio *radio, const ITransmission *transmission, const simtime_t startTime, const simtime_t endTime, const Coord startPosition, const Coord endPosition, const Quaternion startOrientation, const Quaternion endOrientation, Hz LoRaCF, Hz LoRaBW, W receivedPower, int LoRaSF, int LoRaCR) :
+LoRaReception::LoRaReception(const IRadio *radio, const ITransmission *transmission, const simtime_t startTime, const simtime_t endTime, const Coord startPosition, const Coord endPosition, const Quaternion startOrientation, const Quaternion endOrientation, Hz LoRaCF, Hz LoRaBW, W receivedPower, double receivedPowerDbm, int LoRaSF, int LoRaCR) :
         ScalarReception(radio, transmission, startTime, endTime, startPosition, endPosition, startOrientation, endOrientation, LoRaCF, LoRaBW, receivedPower),
         LoRaCF(LoRaCF),
         LoRaSF(LoRaSF),
         LoRaBW(LoRaBW),
         LoRaCR(LoRaCR),
-        receivedPower(receivedPower)
+        receivedPower(receivedPower),
+        receivedPowerDbm(receivedPowerDbm)
 {
 }
 
@@ -22,8 +22,9 @@ protected:
     const Hz LoRaBW;
     const double LoRaCR;
     const W receivedPower;
+    const double receivedPowerDbm;
   public:
-    LoRaReception(const IRadio *radio, const ITransmission *transmission, const simtime_t startTime, const simtime_t endTime, const Coord startPosition, const Coord endPosition, const Quaternion startOrientation, const Quaternion endOrientation, Hz LoRaCF, Hz LoRaBW, W receivedPower, int LoRaSF, int LoRaCR);
+    LoRaReception(const IRadio *radio, const ITransmission *transmission, const simtime_t startTime, const simtime_t endTime, const Coord startPosition, const Coord endPosition, const Quaternion startOrientation, const Quaternion endOrientation, Hz LoRaCF, Hz LoRaBW, W receivedPower, double receivedPowerDbm, int LoRaSF, int LoRaCR);
 
     Hz getLoRaCF() const { return LoRaCF; }
     int getLoRaSF() const { return LoRaSF; }
@@ -31,6 +32,7 @@ protected:
     double getLoRaCR() const { return LoRaCR; }
 
     virtual W getPower() const override { return receivedPower; }
+    double getPowerDbm() const { return receivedPowerDbm; }
     virtual W computeMinPower(simtime_t startTime, simtime_t endTime) const override;
 };
 
@@ -0,0 +1,132 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef LORAPHY_LORATHREADPOOL_H_
+#define LORAPHY_LORATHREADPOOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flora {
+
+/**
+ * Fixed set of worker threads running index ranges of a side effect free
+ * function. The indices are handed out in contiguous chunks, one lock per
+ * chunk; the calling thread takes part in the work and parallelFor()
+ * returns only when every index is done, so the simulation never observes
+ * the workers.
+ */
+class LoRaThreadPool
+{
+  protected:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    const std::function<void (int)> *job = nullptr;
+    int minChunkSize = 1;
+    int chunkSize = 1;
+    int numIndices = 0;
+    int nextIndex = 0;
+    int finishedIndices = 0;
+    long generation = 0;
+    bool stopping = false;
+
+    // takes chunks of the current job until none are left
+    void runChunks(std::unique_lock<std::mutex>& lock)
+    {
+        while (nextIndex < numIndices) {
+            int begin = nextIndex;
+            int end = std::min(begin + chunkSize, numIndices);
+            nextIndex = end;
+            const std::function<void (int)> *function = job;
+            lock.unlock();
+            for (int index = begin; index < end; index++)
+                (*function)(index);
+            lock.lock();
+            finishedIndices += end - begin;
+            if (finishedIndices == numIndices)
+                workDone.notify_all();
+        }
+    }
+
+    void workerMain()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        long seenGeneration = 0;
+        while (true) {
+            workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+            runChunks(lock);
+        }
+    }
+
+  public:
+    /** Jobs with fewer than 2 * minChunkSize indices run on the caller only. */
+    LoRaThreadPool(int numThreads, int minChunkSize) :
+        minChunkSize(std::max(1, minChunkSize))
+    {
+        // the caller is one of the threads
+        for (int i = 1; i < numThreads; i++)
+            workers.emplace_back(&LoRaThreadPool::workerMain, this);
+    }
+
+    ~LoRaThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    int getNumThreads() const { return workers.size() + 1; }
+
+    /** Calls function(i) for every i in [0, n), possibly concurrently. */
+    void parallelFor(int n, const std::function<void (int)>& function)
+    {
+        if (n < 2 * minChunkSize || workers.empty()) {
+            for (int i = 0; i < n; i++)
+                function(i);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &function;
+        // one chunk per thread unless that is below the minimum
+        chunkSize = std::max(minChunkSize, (n + getNumThreads() - 1) / getNumThreads());
+        numIndices = n;
+        nextIndex = 0;
+        finishedIndices = 0;
+        generation++;
+        workAvailable.notify_all();
+        runChunks(lock);
+        workDone.wait(lock, [&] { return finishedIndices == numIndices; });
+        job = nullptr;
+        numIndices = 0;
+        nextIndex = 0;
+    }
+};
+
+} // namespace flora
+
+#endif /* LORAPHY_LORATHREADPOOL_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "LoRaTransmission.h"
+#include "inet/common/INETMath.h"
 
 namespace flora {
 LoRaTransmission::LoRaTransmission(const IRadio *transmitter, const Packet *macFrame, const simtime_t startTime, const simtime_t endTime, const simtime_t preambleDuration, const simtime_t headerDuration, const simtime_t dataDuration, const Coord startPosition, const Coord endPosition, const Quaternion startOrientation, const Quaternion endOrientation, W LoRaTP, Hz LoRaCF, int LoRaSF, Hz LoRaBW, int LoRaCR):
@@ -20,6 +21,20 @@ LoRaTransmission::LoRaTransmission(const IRadio *transmitter, const Packet *macF
 
 }
 
+const LoRaTransmission::ReceptionPower *LoRaTransmission::getCachedReceptionPower(int radioId) const
+{
+    auto it = receptionPowers.find(radioId);
+    return it != receptionPowers.end() ? &it->second : nullptr;
+}
+
+const LoRaTransmission::ReceptionPower& LoRaTransmission::setCachedReceptionPower(int radioId, W power) const
+{
+    ReceptionPower& entry = receptionPowers[radioId];
+    entry.power = power;
+    entry.powerDbm = math::mW2dBmW(power.get() * 1000);
+    return entry;
+}
+
 std::ostream& LoRaTransmission::printToStream(std::ostream& stream, int level, int evFlags) const
 {
     return TransmissionBase::printToStream(stream, level);
@@ -10,13 +10,26 @@
 
 #include "inet/physicallayer/wireless/common/base/packetlevel/TransmissionBase.h"
 #include "inet/physicallayer/wireless/common/contract/packetlevel/IRadioSignal.h"
+#include <unordered_map>
 
 using namespace inet;
 using namespace inet::physicallayer;
 namespace flora {
 class LoRaTransmission : public TransmissionBase, public virtual INarrowbandSignal, public virtual IScalarSignal
 {
+public:
+    // received power at one receiver, NaN until computed
+    struct ReceptionPower {
+        W power = W(NaN);
+        double powerDbm = NaN;
+    };
+
 protected:
+    // keyed by receiver radio id, only for the receivers in range: filled by
+    // LoRaMedium::addTransmission and on demand by
+    // LoRaAnalogModel::computeReceptionPower; entries never move once added
+    mutable std::unordered_map<int, ReceptionPower> receptionPowers;
+
     const W LoRaTP;
     const Hz LoRaCF;
     const int LoRaSF;
@@ -36,6 +49,9 @@ public:
     Hz getLoRaBW() const { return LoRaBW; }
     int getLoRaCR() const { return LoRaCR; }
 
+    const ReceptionPower *getCachedReceptionPower(int radioId) const;
+    const ReceptionPower& setCachedReceptionPower(int radioId, W power) const;
+
     virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
 };
 
@@ -63,19 +63,16 @@ const ITransmission *LoRaTransmitter::createTransmission(const IRadio *transmitt
     EV << macFrame->getDetailStringRepresentation(evFlags) << endl;
     const auto &frame = macFrame->peekAtFront<LoRaPhyPreamble>();
 
-    int nPreamble = 8;
-    simtime_t Tsym = (pow(2, frame->getSpreadFactor()))/(frame->getBandwidth().get()/1000);
-    simtime_t Tpreamble = (nPreamble + 4.25) * Tsym / 1000;
-
-    //preambleDuration = Tpreamble;
-    int payloadBytes = 0;
-    if(iAmGateway) payloadBytes = 15;
-    else payloadBytes = 20;
-    int payloadSymbNb = 8;
-    payloadSymbNb += std::ceil((8*payloadBytes - 4*frame->getSpreadFactor() + 28 + 16 - 20*0)/(4*(frame->getSpreadFactor()-2*0)))*(frame->getCodeRendundance() + 4);
-    if(payloadSymbNb < 8) payloadSymbNb = 8;
-    simtime_t Theader = 0.5 * (8+payloadSymbNb) * Tsym / 1000;
-    simtime_t Tpayload = 0.5 * (8+payloadSymbNb) * Tsym / 1000;
+    // the PHY payload is everything behind the preamble chunk, i.e. the MAC
+    // header and whatever the application put into the frame
+    int payloadBytes = B(macFrame->getDataLength() - frame->getChunkLength()).get();
+    if (payloadBytes > 255)
+        throw cRuntimeError("LoRa frame payload of %d bytes exceeds the 255 byte maximum", payloadBytes);
+    simtime_t Tpreamble;
+    simtime_t Tdata;
+    computeAirtime(payloadBytes, frame->getSpreadFactor(), frame->getBandwidth(), frame->getCodeRendundance(), Tpreamble, Tdata);
+    simtime_t Theader = 0.5 * Tdata;
+    simtime_t Tpayload = 0.5 * Tdata;
 
     const simtime_t duration = Tpreamble + Theader + Tpayload;
     const simtime_t endTime = startTime + duration;
@@ -114,4 +111,22 @@ const ITransmission *LoRaTransmitter::createTransmission(const IRadio *transmitt
             frame->getBandwidth(),
             frame->getCodeRendundance());}
 
+void LoRaTransmitter::computeAirtime(int payloadBytes, int spreadFactor, Hz bandwidth, int codeRendundance, simtime_t& preambleDuration, simtime_t& payloadDuration)
+{
+    int nPreamble = 8;
+    double Tsym = pow(2, spreadFactor) / bandwidth.get();
+    int lowDataRateOptimize = Tsym > 0.016 ? 1 : 0;
+    preambleDuration = (nPreamble + 4.25) * Tsym;
+    double payloadSymbols = std::ceil((8.0 * payloadBytes - 4 * spreadFactor + 28 + 16 - 20 * 0) / (4 * (spreadFactor - 2 * lowDataRateOptimize))) * (codeRendundance + 4);
+    payloadDuration = (8 + std::max(payloadSymbols, 0.0)) * Tsym;
+}
+
+simtime_t LoRaTransmitter::computeAirtime(int payloadBytes, int spreadFactor, Hz bandwidth, int codeRendundance)
+{
+    simtime_t preambleDuration;
+    simtime_t payloadDuration;
+    computeAirtime(payloadBytes, spreadFactor, bandwidth, codeRendundance, preambleDuration, payloadDuration);
+    return preambleDuration + payloadDuration;
+}
+
 }
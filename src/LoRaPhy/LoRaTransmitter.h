@@ -31,6 +31,14 @@ class LoRaTransmitter : public FlatTransmitterBase {
         virtual std::ostream& printToStream(std::ostream& stream, int level, int evFlags = 0) const override;
         virtual const ITransmission *createTransmission(const IRadio *radio, const Packet *packet, const simtime_t startTime) const override;
 
+        /**
+         * Preamble and header+payload durations of a frame carrying
+         * payloadBytes of PHY payload (Semtech AN1200.13, explicit header,
+         * low data rate optimization for symbols longer than 16 ms).
+         */
+        static void computeAirtime(int payloadBytes, int spreadFactor, Hz bandwidth, int codeRendundance, simtime_t& preambleDuration, simtime_t& payloadDuration);
+        static simtime_t computeAirtime(int payloadBytes, int spreadFactor, Hz bandwidth, int codeRendundance);
+
     private:
 
         bool iAmGateway;